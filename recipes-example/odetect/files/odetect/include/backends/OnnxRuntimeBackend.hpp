@@ -0,0 +1,45 @@
+#ifndef ONNXRUNTIMEBACKEND_HPP
+#define ONNXRUNTIMEBACKEND_HPP
+
+#include "interfaces/backends/IInferenceBackend.hpp"
+#include "utils/MappedFile.hpp"
+#include "utils/LayerProfile.hpp"
+
+#include <memory>
+#include <mutex>
+#include <onnxruntime_cxx_api.h>
+
+// ONNX Runtime with the CPU execution provider. The model is mapped read-only and
+// must outlive the session: ORT format models use it in place. Optimized graphs are
+// kept in the model cache as ORT format models and loaded from there on the next
+// start, skipping graph optimization. One session serves all contexts, Run is
+// thread-safe, each context binds its own input tensor through IOBinding directly on
+// top of the blob memory, outputs stay in ORT owned memory. Layer profiles come from
+// the ORT session profiler, its JSON file is kept for chrome://tracing.
+class OnnxRuntimeBackend : public IInferenceBackend {
+private:
+    class Context;
+
+    std::unique_ptr<MappedFile> modelFile;
+    Ort::Session session{nullptr};
+    Ort::MemoryInfo memoryInfo{nullptr};
+
+    std::string inputName;
+    std::vector<std::string> outputNames;
+
+    std::mutex mutex;
+    std::unique_ptr<LayerProfile> layerProfile;
+    bool profileTaken = false;
+
+    static Ort::Env& Env();
+
+    static std::unique_ptr<IInferenceBackend> Construct(const ModelSource& source, const BackendParams& params);
+    friend struct BackendFactory;
+
+public:
+    OnnxRuntimeBackend(const ModelSource& source, const BackendParams& params);
+
+    std::unique_ptr<IInferenceBackend::Context> CreateContext() override;
+};
+
+#endif // ONNXRUNTIMEBACKEND_HPP
\ No newline at end of file
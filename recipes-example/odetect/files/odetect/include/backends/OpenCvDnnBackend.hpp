@@ -0,0 +1,38 @@
+#ifndef OPENCVDNNBACKEND_HPP
+#define OPENCVDNNBACKEND_HPP
+
+#include "interfaces/backends/IInferenceBackend.hpp"
+#include "utils/LayerProfile.hpp"
+
+#include <memory>
+#include <mutex>
+#include <opencv2/dnn.hpp>
+
+// cv::dnn::Net can't share its weights between nets nor run two passes at once,
+// so every context is a net of its own with a copy of the weights. odetect keeps
+// models on it to one context, see --contexts
+class OpenCvDnnBackend : public IInferenceBackend {
+private:
+    class Context;
+
+    const ModelSource source;
+    const BackendParams params;
+    std::mutex mutex;
+    // Built at load to fail early, handed out first
+    std::unique_ptr<Context> loaded;
+    std::unique_ptr<LayerProfile> layerProfile;
+
+    cv::dnn::Net ReadNet() const;
+
+    static std::unique_ptr<IInferenceBackend> Construct(const ModelSource& source, const BackendParams& params);
+    friend struct BackendFactory;
+
+public:
+    OpenCvDnnBackend(const ModelSource& source, const BackendParams& params);
+    ~OpenCvDnnBackend() override;
+
+    std::unique_ptr<IInferenceBackend::Context> CreateContext() override;
+    bool SupportsBatch() const override { return true; }
+};
+
+#endif // OPENCVDNNBACKEND_HPP
\ No newline at end of file
@@ -0,0 +1,43 @@
+#ifndef TFLITEBACKEND_HPP
+#define TFLITEBACKEND_HPP
+
+#include "interfaces/backends/IInferenceBackend.hpp"
+#include "utils/LayerProfile.hpp"
+
+#include <memory>
+#include <mutex>
+#include <tensorflow/lite/interpreter.h>
+#include <tensorflow/lite/model.h>
+#include <tensorflow/lite/profiling/buffered_profiler.h>
+
+// TensorFlow Lite with the XNNPACK delegate, meant for the arm64 boards. Float, FP16
+// (float16 weights) and INT8 quantized models are accepted: NCHW blobs are repacked
+// to NHWC inputs and quantized on the way in, quantized outputs are dequantized.
+// Where XNNPACK supports it, packed weights persist in the model cache. Contexts are
+// interpreters of their own over the one mapped flatbuffer; with the weight cache
+// they also share the packed weights through its mapping.
+class TfLiteBackend : public IInferenceBackend {
+private:
+    class Context;
+
+    const BackendParams params;
+    const std::string modelPath;
+    std::string weightCachePath;
+    std::unique_ptr<tflite::FlatBufferModel> model;
+
+    std::mutex mutex;
+    // Built at load to fail early and fill the weight cache, handed out first
+    std::unique_ptr<Context> loaded;
+    std::unique_ptr<LayerProfile> layerProfile;
+
+    static std::unique_ptr<IInferenceBackend> Construct(const ModelSource& source, const BackendParams& params);
+    friend struct BackendFactory;
+
+public:
+    TfLiteBackend(const ModelSource& source, const BackendParams& params);
+    ~TfLiteBackend() override;
+
+    std::unique_ptr<IInferenceBackend::Context> CreateContext() override;
+};
+
+#endif // TFLITEBACKEND_HPP
\ No newline at end of file
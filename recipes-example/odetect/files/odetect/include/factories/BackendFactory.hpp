@@ -0,0 +1,24 @@
+#ifndef BACKENDFACTORY_HPP
+#define BACKENDFACTORY_HPP
+
+#include "interfaces/backends/IInferenceBackend.hpp"
+
+#include <memory>
+#include <string>
+#include <map>
+
+struct BackendFactory {
+    struct Unit {
+        std::vector<ModelFormat> formats;
+        std::vector<Precision> precisions;
+        std::unique_ptr<IInferenceBackend>(*construct)(const ModelSource&, const BackendParams&);
+    };
+
+    // Backends by name. Tests add stand-ins that replay canned network outputs
+    static std::map<std::string, Unit> factory;
+
+    // Builds params.name on the first of the model's params.precision sources the backend can read
+    static std::unique_ptr<IInferenceBackend> Create(const std::vector<ModelSource>& sources, const BackendParams& params);
+};
+
+#endif // BACKENDFACTORY_HPP
\ No newline at end of file
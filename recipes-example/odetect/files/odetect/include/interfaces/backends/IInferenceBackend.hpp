@@ -0,0 +1,78 @@
+#ifndef IINFERENCEBACKEND_HPP
+#define IINFERENCEBACKEND_HPP
+
+#include <opencv2/core.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class ModelFormat {
+    Caffe,
+    Onnx,
+    TfLite,
+};
+
+enum class Precision {
+    FP32,
+    FP16,
+    INT8,
+};
+
+Precision ParsePrecision(const std::string& name);
+const char* PrecisionToString(Precision precision);
+
+struct ModelSource {
+    ModelFormat format;
+    Precision precision;
+    std::string model;  // weights or a single file model
+    std::string config; // network description, Caffe only
+};
+
+struct BackendParams {
+    std::string name = "opencv";
+    Precision precision = Precision::FP32;
+    cv::Size inputSize;              // network input, set by the model
+    std::string cacheDir;            // compiled model cache, empty - disabled
+    int profileLayers = 0;           // forward passes to profile per layer, 0 - off. See LayerProfile
+
+    // ONNX Runtime CPU execution provider
+    std::string ortOptLevel = "all"; // disable|basic|extended|all
+    int ortIntraOpThreads = 0;       // 0 - runtime default
+    int ortInterOpThreads = 0;
+    bool ortArena = true;
+
+    // TensorFlow Lite with the XNNPACK delegate
+    int tfliteThreads = 0;           // 0 - all cores
+};
+
+// "<model file> <input WxH> <backend> <precision>", names the reports of a backend
+std::string BackendTitle(const ModelSource& source, const BackendParams& params);
+
+// Copies a network output into dst, reusing its buffer once the shape is known.
+// cv::Mat::copyTo and header copies of blobs of more than 2 dimensions allocate
+void CopyOutput(const cv::Mat& src, cv::Mat& dst);
+
+// The loaded model. Its execution contexts share the weights where the runtime allows
+// it, see OpenCvDnnBackend for one that doesn't
+class IInferenceBackend {
+public:
+    // Activations, bindings and outputs of one forward pass at a time. Contexts of a
+    // backend run concurrently, each on one thread at a time
+    class Context {
+    public:
+        // blob is NCHW float32 as produced by cv::dnn::blobFromImage. outs are all network
+        // outputs in declaration order and stay valid until the next Forward call.
+        virtual void Forward(const cv::Mat& blob, std::vector<cv::Mat>& outs) = 0;
+
+        virtual ~Context() = default;
+    };
+
+    // Thread-safe. Contexts must not outlive the backend
+    virtual std::unique_ptr<Context> CreateContext() = 0;
+    // Blobs of more than one image are accepted if the network allows it
+    virtual bool SupportsBatch() const { return false; }
+
+    virtual ~IInferenceBackend() = default;
+};
+
+#endif // IINFERENCEBACKEND_HPP
\ No newline at end of file
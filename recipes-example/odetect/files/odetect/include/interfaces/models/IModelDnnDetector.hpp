@@ -2,29 +2,226 @@
 #define IMODELDNNDETECTOR_HPP
 
 #include "odetect.h"
+#include "interfaces/backends/IInferenceBackend.hpp"
+#include "utils/RoiMask.hpp"
+#include "utils/ObjectPool.hpp"
 
 #include <opencv2/opencv.hpp>
+#include <array>
 #include <string>
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <mutex>
 
 #define COLOR_CVT_NONE -1
 
 using ColorCvtId = uint32_t;
 
+// Passed to the models as modelData
+struct DetectorParams {
+    float threshold;
+    BackendParams backend;
+    // Square network input side, 0 - the model default. The network must allow it
+    int inputSize = 0;
+    // Restricts detection to zones of the frame, nullptr - whole frame
+    std::shared_ptr<const RoiMask> roi;
+    // Splits the frame (or the ROI) into overlapping tiles, 0 tile size - model input
+    bool tiling = false;
+    int tileSize = 0;
+    float tileOverlap = 0.25;
+    // Skips inference on still frames, 0 - off. See MotionGate
+    float motionSensitivity = 0;
+    int motionMaxSkip = 30;
+    // Second pass on full resolution crops around small or weak first pass candidates
+    bool refine = false;
+    float refineThreshold = 0.3;
+    int refineMax = 8;
+    // Forward passes the model may run at once, each on an execution context of its own.
+    // Whether the contexts share the weights is up to the backend, opencv ones don't
+    int contexts = 1;
+};
+
+// Landmarks of a detection, fixed capacity so that detections are copied from frame to
+// frame without allocating
+class Landmarks {
+public:
+    static constexpr size_t capacity = 5;
+
+private:
+    std::array<cv::Point, capacity> points;
+    size_t count = 0;
+
+public:
+    // Points past the capacity are dropped
+    void push_back(const cv::Point& point) {
+        if (count < capacity) {
+            points[count++] = point;
+        }
+    }
+    void clear() { count = 0; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const cv::Point& operator[](size_t i) const { return points[i]; }
+
+    cv::Point* begin() { return points.data(); }
+    cv::Point* end() { return points.data() + count; }
+    const cv::Point* begin() const { return points.data(); }
+    const cv::Point* end() const { return points.data() + count; }
+};
+
+struct ODDetection {
+    cv::Rect box;
+    float confidence;
+    Landmarks landmarks;
+};
+
+class TileGrid;
+class MotionGate;
+
+// One pass of the network split into its stages, so that passes of consecutive frames
+// can be in different stages on different threads. The stages of a pass run in order
+class InferPass {
+public:
+    virtual void Preprocess(const cv::Mat& bgrFrame) = 0;
+    // The outputs stay with the pass, forward passes of other passes don't touch them
+    virtual void Forward() = 0;
+    // Boxes in bgrFrame coordinates
+    virtual void Decode(float threshold, std::vector<ODDetection>& detections) = 0;
+
+    virtual ~InferPass() = default;
+};
+
 class IModelDnnDetector {
+public:
+    // State of one frame going through Detect, reused from frame to frame so the steady
+    // state doesn't allocate (see AllocTracker). Opaque to callers
+    struct Frame {
+        std::vector<uint8_t> buffer;
+        cv::Mat image;
+        std::unique_ptr<InferPass> pass; // created by the first staged frame
+        bool infer = false;  // false - skipped by the motion gate
+        bool staged = false; // the pass is split, otherwise Forward runs all of the inference
+        std::vector<ODDetection> detections;
+        std::vector<ODDetection> regionDetections;
+    };
+    using FrameLease = ObjectPool<Frame>::Lease;
+
+private:
+    cv::Size tileSize;
+    float tileOverlap;
+    std::unique_ptr<TileGrid> tileGrid;
+    float refineThreshold;
+    int refineMax;
+    const int refineMinInput = 24; // boxes smaller than this at the network input are refined
+    const float refineNmsThreshold = 0.45;
+    // Shared by all callers, results are reused while skipping
+    std::unique_ptr<MotionGate> motionGate;
+    mutable std::mutex motionMutex;
+    mutable std::vector<ODDetection> lastDetections;
+
+    // One per frame being detected at once
+    mutable ObjectPool<Frame> frames;
+
+    void BuildTiles();
+    bool CheckMotion(const OdBuf inBuf) const;
+    void RememberDetections(const std::vector<ODDetection>& detections) const;
+    void RecallDetections(std::vector<ODDetection>& detections) const;
+    void InferTiles(const cv::Mat& region, std::vector<ODDetection>& detections) const;
+    void InferRefined(const cv::Mat& region, std::vector<ODDetection>& detections) const;
+    void InferArea(const cv::Mat& area, std::vector<ODDetection>& detections) const;
+    // Infer on the ROI bounding box, tile by tile or coarse to fine if enabled. Boxes
+    // are mapped back to the frame and filtered by the zones
+    void InferRegions(Frame& frame, const cv::Mat& bgrFrame, std::vector<ODDetection>& detections) const;
+    // Boxes found on the ROI bounding box to the frame, outside the zones are dropped
+    void MapRegion(std::vector<ODDetection>& found, std::vector<ODDetection>& detections) const;
+    // Prepare(), split - the pass is staged for Forward and Finish on other threads
+    FrameLease PrepareFrame(const OdBuf inBuf, bool split) const;
+    // fn(begin, end) over [0, count) on up to contexts threads
+    template <typename Fn>
+    void ParallelRun(int count, const Fn& fn) const;
+
 protected:
     const ODCaps inCaps;
     ColorCvtId colorConvertId;
+    std::atomic<float> modelThreshold;
+    std::shared_ptr<const RoiMask> roi;
+    cv::Size inputSize; // network input, set by the model
+    int contexts;       // execution contexts, set by the model
+
+    // Working lists of one inference call, reused from frame to frame. Each call takes
+    // its own, nested calls included
+    struct Scratch {
+        std::vector<ODDetection> found;
+        std::vector<ODDetection> results;
+        std::vector<ODDetection> candidates;
+        std::vector<cv::Rect> windows;
+        std::vector<cv::Mat> views;
+        std::vector<std::vector<ODDetection>> batch;
+        std::vector<cv::Rect> boxes;
+        std::vector<float> scores;
+        std::vector<int> indices;
+
+        // Empties the lists, their capacity stays
+        void Clear();
+    };
+    mutable ObjectPool<Scratch> scratch;
 
     IModelDnnDetector(const ODCaps& inCaps);
 
     void InputPreProcess(const OdBuf inBuf, cv::Mat& outFrame) const;
+    void DrawDetections(cv::Mat& frame, const std::vector<ODDetection>& detections) const;
+    // A split single pass for the staged Detect, nullptr if the model can't split its passes
+    virtual std::unique_ptr<InferPass> NewPass() const { return nullptr; }
+    // Forward passes on every execution context of the model, see WarmUp(). Models with
+    // contexts of their own hold all of them at once, the default runs Infer on the frame
+    virtual void WarmUpContexts(const cv::Mat& bgrFrame, int iterations) const;
 
 public:
-    virtual bool Detect(const OdBuf inBuf, OdBuf outBuf) const = 0;
+    // Everything below is thread-safe unless noted otherwise
+
+    // Runs the network on a BGR frame, boxes are returned in frame coordinates
+    virtual void Infer(const cv::Mat& bgrFrame, float threshold, std::vector<ODDetection>& detections) const = 0;
+    // Frames one by one, on up to contexts threads. Models override it when their backend
+    // takes batches
+    virtual void InferBatch(const std::vector<cv::Mat>& bgrFrames, float threshold, std::vector<std::vector<ODDetection>>& detections) const;
+    // Same with the current threshold
+    void Infer(const cv::Mat& bgrFrame, std::vector<ODDetection>& detections) const;
+
+    // Detects and burns the results into outBuf (BGR, inCaps size)
+    bool Detect(const OdBuf inBuf, OdBuf outBuf) const;
+    // Detects only, the frame itself is left untouched
+    bool Detect(const OdBuf inBuf, std::vector<ODDetection>& detections) const;
+
+    // The first Detect split into stages for software pipelining, see PipelinedDetector.
+    // A frame goes through them in order, consecutive frames may be in different stages
+    // at once, each stage on a thread of its own. A split pass hands its outputs from the
+    // forward stage to decoding as a copy, Detect itself doesn't split.
+    // Copy, color conversion, motion check and the input blob
+    FrameLease Prepare(const OdBuf inBuf) const;
+    // Forward pass. Tiling and refinement run all of their passes here
+    void Forward(Frame& frame) const;
+    // Decode, NMS and zones, then the detections are burnt into outBuf
+    void Finish(Frame& frame, OdBuf outBuf) const;
+
+    // Takes effect from the next frame, safe to call while frames are being detected
+    void SetThreshold(float threshold);
+    float GetThreshold() const;
+
+    // Network input of the model
+    const cv::Size& InputSize() const { return inputSize; }
+
+    // Set up before the detector is in use
+    void SetRoi(std::shared_ptr<const RoiMask> roi);
+    void SetTiling(int tileSize, float overlap);
+    void SetRefinement(float candidateThreshold, int maxCandidates);
+    void SetMotionGate(float sensitivity, int maxSkip);
+
+    // Forward passes on a blank frame so lazy backend initialization is paid before
+    // the first real frame, iterations on every context. Returns the time spent, ms
+    double WarmUp(int iterations) const;
 
-    virtual ~IModelDnnDetector() = default;
+    virtual ~IModelDnnDetector();
 };
 
 #endif // IMODELDNNDETECTOR_HPP
\ No newline at end of file
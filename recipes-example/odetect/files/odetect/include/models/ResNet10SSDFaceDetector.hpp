@@ -5,22 +5,38 @@
 #include "factories/ModelFactory.hpp"
 
 #include <opencv2/dnn.hpp>
+#include <memory>
 
 class ResNet10SSDFaceDetector : public IModelDnnDetector {
 private:
-    mutable cv::dnn::Net net;
-    mutable OdBuf buffer;
-    uint32_t bufferSize;
+    std::unique_ptr<IInferenceBackend> backend;
     const float modelThDefault = 0.6;
-    float modelThreshold;
+
+    // Backend context and scratch of one Infer at a time, reused from frame to frame
+    struct Context {
+        std::unique_ptr<IInferenceBackend::Context> backend;
+        cv::Mat blob;
+        std::vector<cv::Mat> outs;
+        std::vector<cv::Size> batchSizes;
+    };
+    mutable ObjectPool<Context> contextPool;
+
+    class Pass;
+
+    void Preprocess(const cv::Mat& bgrFrame, cv::Mat& blob) const;
+    // Rows of the detection_out blob are [image, label, confidence, x1, y1, x2, y2]
+    void Decode(const cv::Mat& out, float threshold, const cv::Size* frameSizes, std::vector<ODDetection>* detections, size_t count) const;
+
+    std::unique_ptr<InferPass> NewPass() const override;
+    void WarmUpContexts(const cv::Mat& bgrFrame, int iterations) const override;
 
     static std::unique_ptr<IModelDnnDetector> Construct(const std::string& modelDir, const ODCaps inCaps, const void* modelData);
     friend struct ModelFactory;
 public:
     ResNet10SSDFaceDetector(const std::string& modelDir, const ODCaps inCaps, const void* modelData);
-    ~ResNet10SSDFaceDetector();
 
-    bool Detect(const OdBuf inBuf, OdBuf outBuf) const override;
+    void Infer(const cv::Mat& bgrFrame, float threshold, std::vector<ODDetection>& detections) const override;
+    void InferBatch(const std::vector<cv::Mat>& bgrFrames, float threshold, std::vector<std::vector<ODDetection>>& detections) const override;
 };
 
 #endif // RESNET10SSDFACEDETECTOR_HPP
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef SSDYOLOCASCADEDETECTOR_HPP
+#define SSDYOLOCASCADEDETECTOR_HPP
+
+#include "interfaces/models/IModelDnnDetector.hpp"
+#include "factories/ModelFactory.hpp"
+#include "models/ResNet10SSDFaceDetector.hpp"
+#include "models/Yolo5sPersonDetector.hpp"
+
+#include <memory>
+
+// ResNet10-SSD runs on every frame, YOLOv5s-face only on crops around the SSD hits to
+// refine the boxes and add landmarks. A frame without SSD hits costs one SSD pass, each
+// refined hit a YOLO pass at cropInputSize, about a sixteenth of one at 640x640.
+class SsdYoloCascadeDetector : public IModelDnnDetector {
+private:
+    std::unique_ptr<ResNet10SSDFaceDetector> gate;
+    std::unique_ptr<Yolo5sPersonDetector> refiner;
+
+    const float modelThDefault = 0.5;
+    const float gateThresholdMax = 0.4; // the gate favours recall, YOLO rejects the extra hits
+    const float cropScale = 2.0;        // crop side relative to the SSD box
+    const float fullFrameArea = 0.5;    // crops covering more than this keep the SSD boxes
+    const int cropInputSize = 160;      // YOLO input for the crops, a face fills about half of it
+    const size_t maxCrops = 4;          // the most confident hits refined, the others stay SSD boxes
+    const float nmsThreshold = 0.45;
+
+    // Both models, the crops never reach YOLO on a blank frame
+    void WarmUpContexts(const cv::Mat& bgrFrame, int iterations) const override;
+
+    static std::unique_ptr<IModelDnnDetector> Construct(const std::string& modelDir, const ODCaps inCaps, const void* modelData);
+    friend struct ModelFactory;
+
+public:
+    SsdYoloCascadeDetector(const std::string& modelDir, const ODCaps inCaps, const void* modelData);
+
+    void Infer(const cv::Mat& bgrFrame, float threshold, std::vector<ODDetection>& detections) const override;
+};
+
+#endif // SSDYOLOCASCADEDETECTOR_HPP
\ No newline at end of file
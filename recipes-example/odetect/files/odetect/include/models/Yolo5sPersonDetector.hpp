@@ -5,38 +5,56 @@
 #include "factories/ModelFactory.hpp"
 
 #include <string>
+#include <memory>
 #include <opencv2/dnn.hpp>
 
 class Yolo5sPersonDetector : public IModelDnnDetector {
 private:
     const static std::string modelName;
 
-    mutable cv::dnn::Net net;
+    std::unique_ptr<IInferenceBackend> backend;
 
-    OdBuf buffer;
-    uint32_t bufferSize;
     const float modelThDefault = 0.3;
-    float modelThreshold;
-    const uint16_t m_width = 640;
-    const uint16_t m_height = 640;
+    uint16_t m_width = 640;
+    uint16_t m_height = 640;
 
-    float confThreshold, objThreshold;
     const float nmsThreshold = 0.5;
 
+    // Decode scratch, landmarks are 10 coordinates per candidate
+    struct Candidates {
+        std::vector<float> confidences;
+        std::vector<cv::Rect> boxes;
+        std::vector<int> landmarks;
+        std::vector<int> indices;
+    };
+    // Backend context and scratch of one Infer at a time, reused from frame to frame
+    struct Context {
+        std::unique_ptr<IInferenceBackend::Context> backend;
+        cv::Mat blob;
+        std::vector<cv::Mat> outs;
+        Candidates candidates;
+    };
+    mutable ObjectPool<Context> contextPool;
+
+    class Pass;
+
 	const float anchors[3][6] = { {4,5,  8,10,  13,16}, {23,29,  43,55,  73,105},{146,217,  231,300,  335,433} };
 	const float stride[3] = { 8.0, 16.0, 32.0 };
 
     void Sigmoid(cv::Mat* out, int length);
-    void drawPred(float conf, int left, int top, int right, int bottom, cv::Mat& frame, std::vector<int> landmark) const;
+    void Preprocess(const cv::Mat& bgrFrame, cv::Mat& blob) const;
+    void Decode(const cv::Mat& out, const cv::Size& frameSize, float threshold, Candidates& candidates, std::vector<ODDetection>& detections) const;
+
+    std::unique_ptr<InferPass> NewPass() const override;
+    void WarmUpContexts(const cv::Mat& bgrFrame, int iterations) const override;
 
     static std::unique_ptr<IModelDnnDetector> Construct(const std::string& modelDir, const ODCaps inCaps, const void* modelData);
     friend struct ModelFactory;
 
 public:
     Yolo5sPersonDetector(const std::string& modelDir, const ODCaps inCaps, const void* modelData);
-    ~Yolo5sPersonDetector();
 
-    bool Detect(const OdBuf inBuf, OdBuf outBuf) const override;
+    void Infer(const cv::Mat& bgrFrame, float threshold, std::vector<ODDetection>& detections) const override;
 };
 
 #endif // YOLOV5SFACEDETECTOR_HPP
\ No newline at end of file
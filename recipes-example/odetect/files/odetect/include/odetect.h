@@ -28,6 +28,9 @@ uint8_t GetChannelsByPixelFormat(OdPixelFmt type);
 
 uint8_t GetOdCapsFromVideoDev(const char* video_dev_path, ODCaps* caps);
 
+// Caps of the camera's own H264 bitstream (UVC 1.5 / video/x-h264), 0 on success
+uint8_t GetOdH264CapsFromVideoDev(const char* video_dev_path, ODCaps* caps);
+
 #ifdef __cplusplus
 }
 #endif
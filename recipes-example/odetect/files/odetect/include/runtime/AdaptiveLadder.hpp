@@ -0,0 +1,67 @@
+#ifndef ADAPTIVELADDER_HPP
+#define ADAPTIVELADDER_HPP
+
+#include "runtime/DetectorSlot.hpp"
+
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+// Keeps the frame latency within a budget by stepping along a ladder of models, most
+// accurate first. Latency (p90 over a window of frames) and the CPU load of the other
+// processes are checked once per window: a violated budget steps down at once, an
+// upgrade needs several calm windows in a row. odetect's own load is left out, a model
+// keeping the cores busy within the budget is doing its job. Models are swapped
+// through the DetectorSlot on a separate thread, the windows measured during a swap
+// are discarded. A model loaded by someone else (the control socket) moves the ladder
+// to its rung, or pauses it while the model isn't on the ladder.
+class AdaptiveLadder {
+public:
+    struct Rung {
+        std::string model;
+        int inputSize; // 0 - model default
+    };
+
+private:
+    DetectorSlot& slot;
+    const std::vector<Rung> rungs;
+    const double budgetMs;
+    size_t current;
+    size_t pending;
+    bool onLadder;      // the active model is rungs[current]
+    uint64_t loadsSeen; // DetectorSlot::Loads() the ladder knows of
+
+    const size_t windowFrames = 30;
+    const int upgradeWindows = 5;       // calm windows in a row before stepping up
+    const double upgradeHeadroom = 0.6; // calm: p90 below this part of the budget
+    const double cpuHigh = 0.9;
+    const double cpuCalm = 0.7;
+
+    std::vector<double> latencies;
+    int calmWindows;
+    bool discardWindow;
+    std::future<DetectorSlot::LoadTiming> switching;
+    uint64_t cpuBusy;
+    uint64_t cpuTotal;
+    uint64_t selfBusy;
+
+    // Part of all CPUs busy with other processes since the previous call
+    double CpuLoad();
+    void Resync();
+    void Evaluate();
+    void Switch(size_t rung);
+
+public:
+    // "<model>[@<input size>],..." e.g. "Yolo5sPersonDetector@640,ResNet10SSDFaceDetector@300"
+    static std::vector<Rung> ParseLadder(const std::string& spec);
+
+    // The first rung is expected to be active already
+    AdaptiveLadder(DetectorSlot& slot, const std::vector<Rung>& rungs, double budgetMs);
+    ~AdaptiveLadder();
+
+    // Called from the streaming thread after each frame
+    void OnFrame(double latencyMs);
+};
+
+#endif // ADAPTIVELADDER_HPP
\ No newline at end of file
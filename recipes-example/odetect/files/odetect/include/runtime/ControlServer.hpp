@@ -0,0 +1,46 @@
+#ifndef CONTROLSERVER_HPP
+#define CONTROLSERVER_HPP
+
+#include "runtime/DetectorSlot.hpp"
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+// Runtime control over a UNIX stream socket, one text command per connection:
+//   threshold <value>          - new confidence threshold, from the next frame
+//   model <name> [threshold]   - load, warm up and swap in another model
+//   status                     - active model and threshold
+//   stats                      - frame and queue counters, "key value" pairs
+// The reply is a single line starting with "ok" or "error". A client has a few seconds
+// to send its command.
+class ControlServer {
+public:
+    using StatsProvider = std::function<std::string()>;
+
+private:
+    static constexpr int clientTimeoutMs = 3000;
+
+    DetectorSlot& slot;
+    const StatsProvider stats;
+    const std::string path;
+    int listenFd;
+    int stopPipe[2];   // written on destruction, wakes up every wait of the worker
+    std::atomic<bool> running;
+    std::thread worker;
+
+    void Run();
+    // Waits for fd to become readable. false on stop or timeout
+    bool WaitReadable(int fd, int timeoutMs);
+    std::string Handle(const std::string& command);
+
+public:
+    ControlServer(const std::string& path, DetectorSlot& slot, StatsProvider stats = nullptr);
+    ~ControlServer();
+
+    ControlServer(const ControlServer&) = delete;
+    ControlServer& operator=(const ControlServer&) = delete;
+};
+
+#endif // CONTROLSERVER_HPP
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef DETECTIONMETASENDER_HPP
+#define DETECTIONMETASENDER_HPP
+
+#include "interfaces/models/IModelDnnDetector.hpp"
+
+#include <netinet/in.h>
+#include <string>
+#include <vector>
+
+// Sends per-frame detections as one JSON datagram over UDP, used as a side channel
+// when the video itself is forwarded without re-encoding. Coordinates are rescaled
+// from the inference resolution to the resolution of the forwarded stream.
+class DetectionMetaSender {
+private:
+    int sock;
+    sockaddr_in dst;
+    const double scaleX;
+    const double scaleY;
+    std::string message;
+
+public:
+    DetectionMetaSender(const std::string& ip, const std::string& port, const ODCaps& inferCaps, const ODCaps& streamCaps);
+    ~DetectionMetaSender();
+
+    DetectionMetaSender(const DetectionMetaSender&) = delete;
+    DetectionMetaSender& operator=(const DetectionMetaSender&) = delete;
+
+    bool Send(uint64_t seq, uint64_t pts, const std::vector<ODDetection>& detections);
+};
+
+#endif // DETECTIONMETASENDER_HPP
\ No newline at end of file
@@ -0,0 +1,63 @@
+#ifndef DETECTORSLOT_HPP
+#define DETECTORSLOT_HPP
+
+#include "interfaces/models/IModelDnnDetector.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Holds the active detector. Frame callbacks take a reference once per frame, a
+// replacement is built and warmed up off the streaming thread and swapped in between
+// frames, so the stream never waits for a model change. The replaced detector is torn
+// down on the loading thread as well, once the frames in flight let go of it.
+class DetectorSlot {
+public:
+    // Backend, precision and threshold for a model name, throws if it can't be run
+    using ParamsResolver = std::function<DetectorParams(const std::string& modelName)>;
+
+    struct LoadTiming {
+        double loadMs;
+        double warmUpMs;
+        uint64_t loads; // Loads() right after this one
+    };
+
+private:
+    std::shared_ptr<IModelDnnDetector> active;
+    std::string activeName;
+    // Set at runtime, carried over to the models swapped in later. 0 - none
+    float thresholdOverride;
+    uint64_t thresholdChanges;
+    uint64_t loads;
+    // The name and the threshold, swaps are under it too
+    mutable std::mutex stateMutex;
+    std::mutex loadMutex;
+
+    const std::string modelDir;
+    const ODCaps inCaps;
+    const ParamsResolver resolver;
+    const int warmup;
+
+    // Waits for the frames still using a replaced detector, then destroys it here
+    void Retire(std::shared_ptr<IModelDnnDetector> detector);
+
+public:
+    DetectorSlot(const std::string& modelDir, const ODCaps& inCaps, ParamsResolver resolver, int warmup);
+
+    std::shared_ptr<IModelDnnDetector> Get() const;
+    std::string Name() const;
+    // Models made active so far, tells callers that the model changed under them
+    uint64_t Loads() const;
+
+    // Builds and warms up a model, then makes it active. threshold <= 0 keeps the one
+    // set at runtime, or else takes the resolver's; inputSize <= 0 keeps the model's.
+    // A SetThreshold() while the model loads applies to it as well. Loads are
+    // serialized, detection goes on meanwhile.
+    LoadTiming Load(const std::string& modelName, float threshold = 0, int inputSize = 0);
+
+    void SetThreshold(float threshold);
+};
+
+#endif // DETECTORSLOT_HPP
\ No newline at end of file
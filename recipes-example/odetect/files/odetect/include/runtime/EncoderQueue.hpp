@@ -0,0 +1,42 @@
+#ifndef ENCODERQUEUE_HPP
+#define ENCODERQUEUE_HPP
+
+#include <gst/app/gstappsrc.h>
+
+#include <cstdint>
+#include <string>
+
+// Bounded appsrc queue in front of the encoder. When it is full a push either blocks
+// the capture thread until the encoder catches up, or drops the oldest or the newest
+// queued frame (appsrc leaky-type, GStreamer >= 1.20), so an encoder stall can't grow
+// memory without limit.
+class EncoderQueue {
+public:
+    enum class Policy {
+        Block,
+        DropOldest,
+        DropNewest,
+    };
+
+private:
+    GstAppSrc* appsrc;
+
+public:
+    static Policy ParsePolicy(const std::string& name);
+
+    EncoderQueue(GstAppSrc* appsrc, Policy policy, uint64_t maxBytes, unsigned int maxBuffers);
+    ~EncoderQueue();
+
+    EncoderQueue(const EncoderQueue&) = delete;
+    EncoderQueue& operator=(const EncoderQueue&) = delete;
+
+    // Takes the buffer over
+    GstFlowReturn Push(GstBuffer* buffer);
+
+    uint64_t Dropped() const;
+    uint64_t LevelBytes() const;
+    uint64_t LevelBuffers() const;
+    std::string Summary() const;
+};
+
+#endif // ENCODERQUEUE_HPP
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef FRAMELINEAGE_HPP
+#define FRAMELINEAGE_HPP
+
+#include <gst/gst.h>
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+
+// Links RTP packets to the captured frames they carry. Frames are numbered as they
+// leave the camera source, the PTS is kept all the way to the payloader, and every RTP
+// packet gets two one-byte header extensions (RFC 8285):
+//   CaptureTimeExtId - capture time on the pipeline clock (system monotonic), ns, 8 bytes BE
+//   FrameSeqExtId    - capture sequence number, 4 bytes BE
+// Gaps in the sequence are frames dropped between capture and egress.
+class FrameLineage {
+public:
+    static const uint8_t CaptureTimeExtId = 1;
+    static const uint8_t FrameSeqExtId = 2;
+
+private:
+    struct Entry {
+        GstClockTime pts;
+        uint32_t seq;
+    };
+
+    std::array<Entry, 256> entries;
+    size_t next;
+    uint32_t captured;
+    mutable std::mutex mutex;
+
+    static GstPadProbeReturn OnCapture(GstPad *pad, GstPadProbeInfo *info, gpointer self);
+    static GstPadProbeReturn OnEgress(GstPad *pad, GstPadProbeInfo *info, gpointer self);
+    void Stamp(GstBuffer *rtp, GstClockTime baseTime) const;
+
+public:
+    FrameLineage();
+
+    // Numbers the buffers leaving the capture source
+    void AttachCapture(GstElement *source);
+    // Stamps the RTP packets leaving the payloader
+    void AttachEgress(GstElement *payloader);
+
+    // Capture sequence number of the frame with this PTS, if still remembered
+    bool Lookup(GstClockTime pts, uint32_t& seq) const;
+};
+
+#endif // FRAMELINEAGE_HPP
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef FRAMESCHEDULER_HPP
+#define FRAMESCHEDULER_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Admits a frame only if it can still be done within the deadline, counted from its
+// capture: frames already older than the deadline are stale, frames that would finish
+// after it given the recent processing time are late. Stale frames are always dropped;
+// after a run of drops a late one is admitted anyway, so the processing time estimate
+// keeps up with a changing load.
+// Drops made further down (the encoder queue) are accounted here as well.
+class FrameScheduler {
+public:
+    enum class DropReason {
+        Stale,
+        Late,
+        EncoderQueue,
+        Count,
+    };
+
+private:
+    const double deadlineMs;
+    const int maxConsecutiveDrops = 15;
+    const std::chrono::seconds reportPeriod{10};
+
+    // Written by the thread finishing the frames, see PipelinedDetector
+    std::atomic<double> expectedMs;
+    int consecutiveDrops;
+    std::atomic<uint64_t> admitted;
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(DropReason::Count)> dropped;
+
+    uint64_t reportedDrops;
+    std::chrono::steady_clock::time_point lastReport;
+
+    void Report();
+
+public:
+    // deadlineMs 0 - no deadline, frames are only accounted
+    explicit FrameScheduler(double deadlineMs);
+
+    // ageMs is the time since capture, < 0 if unknown (always admitted)
+    bool Admit(double ageMs);
+    // Processing time of an admitted frame
+    void Done(double processingMs);
+    // Total of drops counted elsewhere
+    void SetDropped(DropReason reason, uint64_t total);
+
+    uint64_t Admitted() const { return admitted; }
+    uint64_t Dropped(DropReason reason) const { return dropped[static_cast<size_t>(reason)]; }
+    std::string Summary() const;
+};
+
+#endif // FRAMESCHEDULER_HPP
\ No newline at end of file
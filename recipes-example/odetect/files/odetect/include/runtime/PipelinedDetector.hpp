@@ -0,0 +1,70 @@
+#ifndef PIPELINEDDETECTOR_HPP
+#define PIPELINEDDETECTOR_HPP
+
+#include "interfaces/models/IModelDnnDetector.hpp"
+#include "utils/SpscQueue.hpp"
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Detect as a three stage software pipeline: the submitting thread prepares frame N+1
+// (copy, color conversion, input blob) while a forward thread runs the network on
+// frame N and a finishing thread decodes, draws and hands out frame N-1. The stages
+// are linked by single slot SPSC queues and there is one job per stage, so Begin()
+// waits while the pipeline is full: a frame comes out one to two frame times later
+// than with Detect, in exchange the stages overlap.
+class PipelinedDetector {
+public:
+    // A frame in flight, callers derive their jobs from it to carry the frame's buffers
+    struct Job {
+        std::shared_ptr<const IModelDnnDetector> detector;
+        OdBuf outBuf = nullptr;
+        uint64_t seq = 0;  // frame of the trace spans, see Tracer::SetFrame
+        std::string error; // a stage failed, the frame isn't annotated
+
+        std::optional<IModelDnnDetector::FrameLease> frame;
+        std::vector<float> stageMs; // see FlightRecorder::TakeStages
+
+        virtual ~Job() = default;
+    };
+
+    using JobFactory = std::function<std::unique_ptr<Job>()>;
+    // Runs on the finishing thread in frame order, the job is reused afterwards
+    using Done = std::function<void(Job& job)>;
+
+private:
+    static const size_t stages = 3;
+
+    const Done done;
+    std::vector<std::unique_ptr<Job>> jobs;
+    SpscQueue<Job*> idle;
+    SpscQueue<Job*> forwardQueue;
+    SpscQueue<Job*> finishQueue;
+    std::thread forwardThread;
+    std::thread finishThread;
+
+    void ForwardLoop();
+    void FinishLoop();
+
+public:
+    PipelinedDetector(const JobFactory& newJob, Done done);
+    ~PipelinedDetector();
+
+    PipelinedDetector(const PipelinedDetector&) = delete;
+    PipelinedDetector& operator=(const PipelinedDetector&) = delete;
+
+    // Begin and Submit are called from one thread. Waits for an idle job
+    Job* Begin();
+    // Prepares the frame on the calling thread and passes it on. inBuf is copied right
+    // away, outBuf has to stay valid until the job is done
+    void Submit(Job* job, std::shared_ptr<const IModelDnnDetector> detector, const OdBuf inBuf, OdBuf outBuf);
+
+    // Finishes the frames in flight and stops the threads
+    void Stop();
+};
+
+#endif // PIPELINEDDETECTOR_HPP
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef ALLOCTRACKER_HPP
+#define ALLOCTRACKER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+enum class Stage;
+
+// Counts the heap allocations made by the frame path, per stage: malloc and friends
+// (operator new and cv::fastMalloc included) are interposed, an allocation counts if
+// the calling thread is between FrameBegin() and FrameDone(). Needs a build with
+// ODETECT_ALLOC_TRACKING (glibc only).
+//
+// In check mode the steady state, frames after a warm-up, must not allocate in the
+// stages that run odetect's own code only (copy, decode, draw); the stages calling into
+// OpenCV, the backends or GStreamer are reported but not checked. Once checkFrames have
+// been counted Finished() turns true and Passed() tells the result.
+class AllocTracker {
+private:
+    static std::atomic<bool> enabled;
+
+    static int EnterStage(Stage stage);
+    static void LeaveStage(int previous);
+
+public:
+    static const int warmUpFrames = 30;
+
+    static bool Available();
+    // checkFrames 0 - report only, every reportSeconds and on Stop()
+    static void Start(int checkFrames, double reportSeconds);
+    static void Stop();
+    static bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+    static void FrameBegin();
+    // The calling thread is done with its part of the frame, another one goes on with it
+    // (FrameBegin) and finishes it
+    static void FrameHandOff();
+    static void FrameDone();
+    // Frame state of the calling thread: its stage, -1 outside a frame. Adopt() puts the
+    // calling thread into the state of another one (see FrameContext) and returns its own
+    static int State();
+    static int Adopt(int state);
+    static bool Finished();
+    static bool Passed();
+    static std::string Report();
+
+    // Allocation stage of the calling thread, see StageScope. -1 while disabled
+    static int Enter(Stage stage) { return Enabled() ? EnterStage(stage) : -1; }
+    static void Leave(int previous) {
+        if (previous >= 0) {
+            LeaveStage(previous);
+        }
+    }
+};
+
+#endif // ALLOCTRACKER_HPP
\ No newline at end of file
@@ -0,0 +1,46 @@
+#ifndef FLIGHTRECORDER_HPP
+#define FLIGHTRECORDER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class Stage;
+
+// Always-on ring of the last frames: stage times, latency and queue depths. Frames are
+// written lock-free (a sequence counter per slot, a torn slot is skipped by the reader)
+// and the ring is dumped as CSV when a frame exceeds the latency threshold, on a bus
+// error, or on SIGUSR1. Dumps are written by Poll() from the main loop, never from the
+// streaming threads.
+class FlightRecorder {
+private:
+    static std::atomic<bool> enabled;
+
+public:
+    // frames - ring size, thresholdMs 0 - no latency triggered dumps
+    static void Start(const std::string& dir, size_t frames, double thresholdMs);
+    static bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // Stage time of the frame the calling thread is working on
+    static void AddStage(Stage stage, int64_t durationNs);
+    // Stage times of a frame handed over to another thread: taken out of the calling
+    // thread's frame and added to the frame of the thread going on with it
+    static void TakeStages(std::vector<float>& stageMs);
+    static void AddStages(const std::vector<float>& stageMs);
+    // Same without allocating, for work done on other threads for the frame (see
+    // FrameContext). stageMs holds a time per Stage
+    static void TakeStages(float* stageMs);
+    static void AddStages(const float* stageMs);
+    // Closes the calling thread's frame. ageMs - capture to admission, < 0 if unknown
+    static void FrameDone(uint32_t seq, double ageMs, double processingMs, uint64_t queueBuffers, uint64_t queueBytes);
+    static void FrameDropped(uint32_t seq, double ageMs);
+
+    // Async-signal-safe, the dump is written by the next Poll()
+    static void RequestDump(const char* reason);
+    static void Poll();
+    // Written right away, the path is empty on failure
+    static std::string Dump(const char* reason);
+};
+
+#endif // FLIGHTRECORDER_HPP
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef LAYERPROFILE_HPP
+#define LAYERPROFILE_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Per layer forward times of one network, summed over a number of forward passes and
+// printed as a table of the hottest layers and layer types with their share of the
+// forward time. The first passes are cold (allocations, caches) and left out.
+class LayerProfile {
+private:
+    struct Layer {
+        std::string name;
+        std::string type;
+        double ms;
+    };
+
+    const int skipPasses = 2;
+
+    const std::string title;
+    const int passes;
+    int seen;
+    int done;
+    double forwardMs;
+    std::vector<Layer> layers;
+    std::map<std::string, size_t> index;
+    std::vector<Layer> pending;
+
+public:
+    LayerProfile(const std::string& title, int passes);
+
+    bool Collecting() const { return done < passes; }
+    // The next PassDone() completes the profile
+    bool LastPass() const { return seen >= skipPasses && done + 1 == passes; }
+    int Passes() const { return passes; }
+    // Time of a layer in the current pass
+    void Add(const std::string& name, const std::string& type, double ms);
+    // Closes the current pass, the report is printed after the last one
+    void PassDone(double forwardMs);
+
+    std::string Report(size_t top = 20) const;
+};
+
+#endif // LAYERPROFILE_HPP
\ No newline at end of file
@@ -0,0 +1,27 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <string>
+#include <cstddef>
+
+// Read-only shared mapping of a whole file. Pages stay in the page cache and are
+// shared by every process mapping the same file, for as long as the mapping is kept:
+// the tflite and onnxruntime backends run on it, OpenCV DNN copies the weights into
+// each net and drops it after loading.
+class MappedFile {
+private:
+    void* data;
+    size_t size;
+
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* Data() const { return static_cast<const char*>(data); }
+    size_t Size() const { return size; }
+};
+
+#endif // MAPPEDFILE_HPP
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef MODELCACHE_HPP
+#define MODELCACHE_HPP
+
+#include "interfaces/backends/IInferenceBackend.hpp"
+#include "utils/MappedFile.hpp"
+
+#include <cstdint>
+#include <string>
+
+// Versioned on-disk cache of backend specific post-optimization model state (ORT
+// format models, packed weights). Entries are keyed by the source model hash, backend,
+// precision and input size, plus a backend tag for anything else the state depends on.
+// Bump Version whenever the meaning of an entry changes.
+class ModelCache {
+private:
+    std::string dir;
+    bool usable;
+
+public:
+    static const int Version = 1;
+
+    explicit ModelCache(const std::string& dir);
+
+    bool Usable() const { return usable; }
+
+    std::string EntryPath(const MappedFile& model, const BackendParams& params, const std::string& tag, const std::string& extension) const;
+
+    // Entries are written next to their final path and renamed in place once complete,
+    // so a crash never leaves a truncated entry behind
+    std::string StagingPath(const std::string& entryPath) const;
+    bool Publish(const std::string& stagingPath, const std::string& entryPath) const;
+
+    static uint64_t Hash(const char* data, size_t size);
+};
+
+#endif // MODELCACHE_HPP
\ No newline at end of file
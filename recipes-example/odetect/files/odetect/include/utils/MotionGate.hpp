@@ -0,0 +1,41 @@
+#ifndef MOTIONGATE_HPP
+#define MOTIONGATE_HPP
+
+#include "odetect.h"
+
+#include <cstdint>
+#include <vector>
+
+// Decides if a frame is worth a forward pass. The luma of the raw input is averaged
+// over a coarse grid of cells and compared with the grid of the last inferred frame,
+// so slow changes add up over the skipped frames.
+class MotionGate {
+private:
+    const ODCaps caps;
+    const float sensitivity;
+    const int maxSkip;
+
+    const int cellThreshold = 16; // luma levels
+    const int sampleStep = 4;     // pixels between samples in a cell
+    int cellSize;
+    int gridWidth;
+    int gridHeight;
+
+    std::vector<uint16_t> reference;
+    std::vector<uint16_t> current;
+    int skipped;
+
+    int Luma(const uint8_t* frame, int x, int y) const;
+    void Sample(const uint8_t* frame, std::vector<uint16_t>& cells) const;
+
+public:
+    // sensitivity - part of the cells (0..1] that must change to trigger inference,
+    // maxSkip - frames skipped at most in a row
+    MotionGate(const ODCaps& caps, float sensitivity, int maxSkip);
+
+    // True if the frame has to be inferred: motion, active detections, the first frame
+    // or maxSkip frames skipped
+    bool Check(const uint8_t* frame, bool activeDetections);
+};
+
+#endif // MOTIONGATE_HPP
\ No newline at end of file
@@ -0,0 +1,103 @@
+#ifndef OBJECTPOOL_HPP
+#define OBJECTPOOL_HPP
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Objects leased to one thread at a time and reused afterwards, created on demand up
+// to a limit. Over the limit Acquire() waits for a lease to come back.
+template <typename T>
+class ObjectPool {
+public:
+    using Factory = std::function<std::unique_ptr<T>()>;
+
+    class Lease {
+    private:
+        ObjectPool* pool;
+        std::unique_ptr<T> object;
+
+    public:
+        Lease(ObjectPool* pool, std::unique_ptr<T> object) : pool(pool), object(std::move(object)) {}
+        Lease(Lease&& other) = default;
+        ~Lease() {
+            if (object) {
+                pool->Release(std::move(object));
+            }
+        }
+
+        T& operator*() const { return *object; }
+        T* operator->() const { return object.get(); }
+    };
+
+private:
+    const Factory factory;
+    const size_t limit;
+    size_t created;
+    std::vector<std::unique_ptr<T>> idle;
+    std::mutex mutex;
+    std::condition_variable released;
+
+    void Release(std::unique_ptr<T> object) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            idle.push_back(std::move(object));
+        }
+        released.notify_one();
+    }
+
+public:
+    // limit 0 - no limit
+    ObjectPool(Factory factory, size_t limit) : factory(std::move(factory)), limit(limit), created(0) {}
+
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    Lease Acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (idle.empty() && (!limit || created < limit)) {
+            created++;
+            lock.unlock();
+            try {
+                return Lease(this, factory());
+            } catch (...) {
+                std::lock_guard<std::mutex> relock(mutex);
+                created--;
+                throw;
+            }
+        }
+        released.wait(lock, [this]() { return !idle.empty(); });
+        std::unique_ptr<T> object = std::move(idle.back());
+        idle.pop_back();
+        return Lease(this, std::move(object));
+    }
+
+    // Creates objects up front until count exist (bounded by the limit), Acquire() hands
+    // them out before creating more
+    void Reserve(size_t count) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (created < count && (!limit || created < limit)) {
+            created++;
+            lock.unlock();
+            std::unique_ptr<T> object;
+            try {
+                object = factory();
+            } catch (...) {
+                std::lock_guard<std::mutex> relock(mutex);
+                created--;
+                throw;
+            }
+            lock.lock();
+            idle.push_back(std::move(object));
+        }
+    }
+
+    size_t Created() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return created;
+    }
+};
+
+#endif // OBJECTPOOL_HPP
\ No newline at end of file
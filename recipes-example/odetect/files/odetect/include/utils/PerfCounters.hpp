@@ -0,0 +1,45 @@
+#ifndef PERFCOUNTERS_HPP
+#define PERFCOUNTERS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+enum class Stage;
+
+// Counter readings of the calling thread
+struct PerfSample {
+    uint64_t values[4];
+    int64_t cpuNs;
+};
+
+// Hardware counters (perf_event_open, user space only) and thread CPU time per stage,
+// reported per frame with the derived IPC. Each thread opens its own counter group on
+// its first stage; where the counters can't be opened (containers, perf_event_paranoid,
+// no PMU) only the wall and CPU times are reported.
+class PerfCounters {
+public:
+    enum Counter {
+        Cycles,
+        Instructions,
+        CacheMisses,
+        BranchMisses,
+        CounterCount,
+    };
+
+private:
+    static std::atomic<bool> enabled;
+
+public:
+    // reportSeconds 0 - report on Stop() only
+    static void Start(double reportSeconds);
+    static void Stop();
+    static bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+    static void Read(PerfSample& sample);
+    static void Add(Stage stage, const PerfSample& begin, const PerfSample& end, int64_t wallNs);
+    static void FrameDone();
+    static std::string Report();
+};
+
+#endif // PERFCOUNTERS_HPP
\ No newline at end of file
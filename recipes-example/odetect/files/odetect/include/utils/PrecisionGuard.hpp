@@ -0,0 +1,19 @@
+#ifndef PRECISIONGUARD_HPP
+#define PRECISIONGUARD_HPP
+
+#include <string>
+
+// Verdicts of odetect-validate for reduced precision modes, one line per mode:
+// <model> <backend> <precision> <recall> accepted|refused
+class PrecisionGuard {
+private:
+    const std::string path;
+
+public:
+    explicit PrecisionGuard(const std::string& path);
+
+    bool IsAccepted(const std::string& model, const std::string& backend, const std::string& precision, float* recall = nullptr) const;
+    void Record(const std::string& model, const std::string& backend, const std::string& precision, float recall, bool accepted) const;
+};
+
+#endif // PRECISIONGUARD_HPP
\ No newline at end of file
@@ -0,0 +1,33 @@
+#ifndef ROIMASK_HPP
+#define ROIMASK_HPP
+
+#include <opencv2/core.hpp>
+#include <string>
+#include <vector>
+
+// Zones of the frame where detection is wanted. Each zone is a rectangle "x,y,w,h" or a
+// polygon "x1,y1,x2,y2,x3,y3[,...]", zones are separated by ';' or newlines in a file.
+// Only the bounding box of all zones is inferred, detections centered outside every
+// zone are dropped.
+class RoiMask {
+private:
+    std::vector<std::vector<cv::Point>> zones;
+    cv::Rect bounds;
+    cv::Mat mask;
+
+    static std::vector<cv::Point> ParseZone(const std::string& zone);
+
+public:
+    // Zone coordinates are given for specSize frames and scaled to frameSize
+    RoiMask(const std::string& spec, const cv::Size& specSize, const cv::Size& frameSize);
+
+    // Same spec, one zone per line, '#' starts a comment
+    static std::string ReadSpec(const std::string& path);
+
+    const cv::Rect& Bounds() const { return bounds; }
+    const std::vector<std::vector<cv::Point>>& Zones() const { return zones; }
+    // True if the box center lies in a zone
+    bool Contains(const cv::Rect& box) const;
+};
+
+#endif // ROIMASK_HPP
\ No newline at end of file
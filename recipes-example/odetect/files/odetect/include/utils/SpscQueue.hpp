@@ -0,0 +1,85 @@
+#ifndef SPSCQUEUE_HPP
+#define SPSCQUEUE_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Bounded ring between one producer and one consumer thread. Push() and Pop() don't
+// lock while the ring is neither full nor empty, a side that has to wait sleeps until
+// the other one makes progress. Close() ends the queue: Push() fails right away,
+// Pop() drains what is left and fails then.
+template <typename T>
+class SpscQueue {
+private:
+    std::vector<T> slots;
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+    std::atomic<bool> closed;
+    std::atomic<int> waiting;
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    template <typename Ready>
+    bool Wait(Ready ready) {
+        if (ready()) {
+            return true;
+        }
+        waiting.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return ready() || closed.load(); });
+        }
+        waiting.fetch_sub(1);
+        return ready();
+    }
+
+    void Wake() {
+        // Orders the index store before the check, pairs with fetch_add in Wait
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(mutex);
+            changed.notify_all();
+        }
+    }
+
+public:
+    explicit SpscQueue(size_t capacity) : slots(capacity), head(0), tail(0), closed(false), waiting(0) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Blocks while full. False if the queue is closed
+    bool Push(T value) {
+        const size_t index = tail.load(std::memory_order_relaxed);
+        if (closed.load() || !Wait([&]() { return index - head.load(std::memory_order_acquire) < slots.size(); })) {
+            return false;
+        }
+        slots[index % slots.size()] = std::move(value);
+        tail.store(index + 1, std::memory_order_release);
+        Wake();
+        return true;
+    }
+
+    // Blocks while empty. False once the queue is closed and drained
+    bool Pop(T& value) {
+        const size_t index = head.load(std::memory_order_relaxed);
+        if (!Wait([&]() { return tail.load(std::memory_order_acquire) != index; })) {
+            return false;
+        }
+        value = std::move(slots[index % slots.size()]);
+        head.store(index + 1, std::memory_order_release);
+        Wake();
+        return true;
+    }
+
+    void Close() {
+        closed.store(true);
+        std::lock_guard<std::mutex> lock(mutex);
+        changed.notify_all();
+    }
+};
+
+#endif // SPSCQUEUE_HPP
\ No newline at end of file
@@ -0,0 +1,124 @@
+#ifndef STAGE_HPP
+#define STAGE_HPP
+
+#include "utils/AllocTracker.hpp"
+#include "utils/FlightRecorder.hpp"
+#include "utils/PerfCounters.hpp"
+#include "utils/Tracer.hpp"
+
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <thread>
+
+// Pipeline stages a frame goes through, the unit of all timing instrumentation
+enum class Stage {
+    Capture,
+    Copy,
+    Preprocess,
+    Forward,
+    Decode,
+    Nms,
+    Draw,
+    Push,
+    Encode,
+    Count,
+};
+
+const char* StageName(Stage stage);
+
+// Same clock as the GStreamer system clock
+inline int64_t MonotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// Times the enclosing scope as one stage span, free while nothing listens (see Tracer,
+// FlightRecorder, PerfCounters, AllocTracker)
+class StageScope {
+private:
+    const Stage stage;
+    const bool perf;
+    const int allocStage;
+    PerfSample perfBegin;
+    int64_t start;
+
+public:
+    explicit StageScope(Stage stage)
+        : stage(stage), perf(PerfCounters::Enabled()), allocStage(AllocTracker::Enter(stage)), start(0)
+    {
+        if (perf) {
+            PerfCounters::Read(perfBegin);
+        }
+        if (perf || Tracer::Enabled() || FlightRecorder::Enabled()) {
+            start = MonotonicNs();
+        }
+    }
+
+    ~StageScope() {
+        AllocTracker::Leave(allocStage);
+        if (!start) {
+            return;
+        }
+        int64_t end = MonotonicNs();
+        if (perf) {
+            PerfSample perfEnd;
+            PerfCounters::Read(perfEnd);
+            PerfCounters::Add(stage, perfBegin, perfEnd, end - start);
+        }
+        Tracer::Record(stage, start, end);
+        FlightRecorder::AddStage(stage, end - start);
+    }
+
+    StageScope(const StageScope&) = delete;
+    StageScope& operator=(const StageScope&) = delete;
+};
+
+// The frame the calling thread works on, as the instrumentation sees it. Work done for
+// it on other threads (the parallel passes of a detector) joins it, so that its spans,
+// allocations and stage times count for the frame rather than for the pool threads.
+// Stage times of work running at once add up, like CPU time
+class FrameContext {
+private:
+    using StageTimes = std::array<float, static_cast<size_t>(Stage::Count)>;
+
+    const std::thread::id owner;
+    const uint64_t traceFrame;
+    const int allocState;
+    std::mutex mutex;
+    StageTimes stageMs;
+
+public:
+    // Of the calling thread
+    FrameContext();
+    // The stage times of the joined work go to the calling thread's frame
+    ~FrameContext();
+
+    FrameContext(const FrameContext&) = delete;
+    FrameContext& operator=(const FrameContext&) = delete;
+
+    // Scope of work for the frame on another thread, a no-op on the owning thread
+    class Join {
+    private:
+        FrameContext& context;
+        const bool foreign;
+        uint64_t traceFrame;
+        int allocState;
+        StageTimes stageMs; // the thread's own, put back afterwards
+
+    public:
+        explicit Join(FrameContext& context);
+        ~Join();
+
+        Join(const Join&) = delete;
+        Join& operator=(const Join&) = delete;
+    };
+};
+
+#define ODETECT_STAGE_CONCAT_(a, b) a##b
+#define ODETECT_STAGE_CONCAT(a, b) ODETECT_STAGE_CONCAT_(a, b)
+#define ODETECT_STAGE(stage) StageScope ODETECT_STAGE_CONCAT(odetectStage, __LINE__)(stage)
+
+#endif // STAGE_HPP
\ No newline at end of file
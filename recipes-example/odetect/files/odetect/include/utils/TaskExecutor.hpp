@@ -0,0 +1,95 @@
+#ifndef TASKEXECUTOR_HPP
+#define TASKEXECUTOR_HPP
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing pool shared by every stage of the process. Each worker owns a bounded
+// deque: it pushes and pops its own tasks at the back, idle workers steal from the front
+// of the others. Threads outside the pool queue through a shared deque. ParallelFor()
+// runs on the caller too, and a caller waiting for its chunks runs those not stolen yet,
+// so loops nested in tasks don't block a worker nor spawn more threads. It runs nothing
+// else meanwhile, an unrelated task could keep it well past the end of its own loop.
+// Tasks are a function pointer and a context, queueing one doesn't allocate.
+class TaskExecutor {
+public:
+    using Body = void (*)(const void* context, int begin, int end);
+
+private:
+    struct Task {
+        void (*run)(void* loop, int chunk);
+        void* loop;
+        int chunk;
+    };
+
+    struct Deque {
+        static constexpr size_t capacity = 256;
+        std::mutex mutex;
+        std::array<Task, capacity> tasks;
+        size_t head = 0;
+        size_t tail = 0;
+
+        bool PushBack(const Task& task);
+        bool PopBack(Task& task);
+        bool PopFront(Task& task);
+        // Newest task of the loop, wherever it is in the deque
+        bool Take(const void* loop, Task& task);
+    };
+
+    struct Loop;
+
+    std::vector<std::unique_ptr<Deque>> deques;   // one per worker, then the shared one
+    std::vector<std::thread> workers;
+    int threadCount;   // workers.size(), readable while they start
+    std::atomic<int> queued;
+    std::atomic<int> sleeping;
+    std::atomic<bool> stopping;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    static std::unique_ptr<TaskExecutor> shared;
+
+    void WorkerLoop(int index);
+    // The worker's own deque, the shared one outside the pool
+    Deque& Local();
+    bool Push(const Task& task);
+    bool RunOne();
+    static void RunChunk(void* loop, int chunk);
+
+public:
+    // threads 0 - one less than the cores, the callers make up for it
+    explicit TaskExecutor(int threads);
+    ~TaskExecutor();
+
+    TaskExecutor(const TaskExecutor&) = delete;
+    TaskExecutor& operator=(const TaskExecutor&) = delete;
+
+    int Threads() const { return threadCount; }
+
+    // 0..Threads()-1 on a worker of this pool, -1 elsewhere
+    int WorkerIndex() const;
+
+    // Splits [0, count) into chunks (0 - one per worker and the caller) and returns once
+    // body ran over all of them. The first exception thrown by body is rethrown here.
+    void ParallelFor(int count, int chunks, Body body, const void* context);
+
+    template <typename Fn>
+    void ParallelFor(int count, int chunks, const Fn& fn) {
+        ParallelFor(count, chunks, [](const void* context, int begin, int end) {
+            (*static_cast<const Fn*>(context))(begin, end);
+        }, &fn);
+    }
+
+    // Creates the process wide pool and makes it OpenCV's parallel_for_ backend
+    static void Start(int threads);
+    static void Stop();
+    // nullptr unless started
+    static TaskExecutor* Shared() { return shared.get(); }
+};
+
+#endif // TASKEXECUTOR_HPP
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef TILEGRID_HPP
+#define TILEGRID_HPP
+
+#include "interfaces/models/IModelDnnDetector.hpp"
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+// Overlapping tiles covering an area, evenly spread so the last tile ends on the
+// area border. Detections of the tiles are merged with a global NMS which also joins
+// the parts of an object cut by a tile seam.
+class TileGrid {
+private:
+    const cv::Size area;
+    std::vector<cv::Rect> tiles;
+
+    const float iouThreshold = 0.45;
+    // Part of the smaller box covered by the other one for seam cut boxes to be joined
+    const float seamOverlap = 0.5;
+    const int seamMargin = 2;
+
+    static std::vector<int> Positions(int length, int tile, float overlap);
+    bool IsCut(const cv::Rect& box, const cv::Rect& tile) const;
+
+public:
+    TileGrid(const cv::Size& area, const cv::Size& tileSize, float overlap);
+
+    const std::vector<cv::Rect>& Tiles() const { return tiles; }
+
+    // detections[i] are in area coordinates and come from Tiles()[i], an extra last
+    // entry holds the results of a whole area pass
+    void Merge(std::vector<std::vector<ODDetection>>& detections, std::vector<ODDetection>& merged) const;
+};
+
+#endif // TILEGRID_HPP
\ No newline at end of file
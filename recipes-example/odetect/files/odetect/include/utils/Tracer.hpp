@@ -0,0 +1,38 @@
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+enum class Stage;
+
+// Opt-in per-frame trace in the Chrome JSON trace format (chrome://tracing, Perfetto UI).
+// Every thread appends its stage spans to its own fixed size buffer without locks,
+// the file is written once the duration or the frame count limit is reached, or on
+// Stop().
+class Tracer {
+private:
+    static std::atomic<bool> enabled;
+
+    static void Finish();
+    static void Write();
+
+public:
+    // frames 0 - bounded by the duration only
+    static void Start(const std::string& path, double seconds, uint64_t frames);
+    // Writes the trace if it is still being recorded
+    static void Stop();
+
+    static bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+    // Frame the calling thread is working on, attached to its following spans
+    static void SetFrame(uint64_t frame);
+    static uint64_t Frame();
+    static void Record(Stage stage, int64_t startNs, int64_t endNs);
+    static void Record(Stage stage, int64_t startNs, int64_t endNs, uint64_t frame);
+    // End of a frame, checks the limits
+    static void FrameDone();
+};
+
+#endif // TRACER_HPP
\ No newline at end of file
@@ -23,8 +23,25 @@ THE SOFTWARE.
 */
 
 #include "factories/ModelFactory.hpp"
+#include "factories/BackendFactory.hpp"
 #include "models/ResNet10SSDFaceDetector.hpp"
 #include "models/Yolo5sPersonDetector.hpp"
+#include "runtime/DetectionMetaSender.hpp"
+#include "runtime/DetectorSlot.hpp"
+#include "runtime/ControlServer.hpp"
+#include "runtime/AdaptiveLadder.hpp"
+#include "runtime/FrameScheduler.hpp"
+#include "runtime/FrameLineage.hpp"
+#include "runtime/EncoderQueue.hpp"
+#include "runtime/PipelinedDetector.hpp"
+#include "utils/AllocTracker.hpp"
+#include "utils/FlightRecorder.hpp"
+#include "utils/PerfCounters.hpp"
+#include "utils/PrecisionGuard.hpp"
+#include "utils/TaskExecutor.hpp"
+#include "utils/RoiMask.hpp"
+#include "utils/Stage.hpp"
+#include "utils/Tracer.hpp"
 #include "cxxopts.hpp"
 
 #include <gst/gst.h>
@@ -32,59 +49,403 @@ THE SOFTWARE.
 #include <gst/app/gstappsrc.h>
 #include <iostream>
 #include <exception>
+#include <stdexcept>
 #include <cstdlib>
 #include <cstring>
 #include <chrono>
 #include <thread>
 #include <memory>
 #include <map>
+#include <sstream>
+#include <future>
+#include <mutex>
+#include <csignal>
+#include <algorithm>
+#include <linux/videodev2.h>
 
 
-std::unique_ptr<IModelDnnDetector> detector;
+static std::unique_ptr<DetectorSlot> detector_slot;
+static std::unique_ptr<AdaptiveLadder> adaptive_ladder;
+static std::unique_ptr<FrameScheduler> frame_scheduler;
+static FrameLineage frame_lineage;
+static std::unique_ptr<EncoderQueue> encoder_queue;
+static std::unique_ptr<PipelinedDetector> frame_pipeline;
+static gsize out_frame_size;
+// Annotated frames cycle through the encoder and back instead of being allocated per frame
+static GstBufferPool *out_pool;
+static std::chrono::steady_clock::time_point process_start;
+
+static void reportFirstFrame() {
+    static std::once_flag reported;
+    std::call_once(reported, []() {
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - process_start);
+        std::cout << "Time to first annotated frame: " << elapsed.count() << " ms" << std::endl;
+    });
+}
+
+// Time since capture from the buffer PTS and the pipeline clock, ms. -1 if unknown
+static double frameAgeMs(GstElement *element, GstBuffer *buffer) {
+    GstClockTime pts = GST_BUFFER_PTS(buffer);
+    GstClock *clock = gst_element_get_clock(element);
+    if (!clock) {
+        return -1;
+    }
+    GstClockTime running = gst_clock_get_time(clock) - gst_element_get_base_time(element);
+    gst_object_unref(clock);
+    if (!GST_CLOCK_TIME_IS_VALID(pts)) {
+        return -1;
+    }
+    return running > pts ? (running - pts) / 1e6 : 0;
+}
+
+// Capture sequence number, see FrameLineage. 0 if no longer known
+static uint32_t frameSeq(GstBuffer *buffer) {
+    uint32_t seq = 0;
+    frame_lineage.Lookup(GST_BUFFER_PTS(buffer), seq);
+    return seq;
+}
+
+// Frames that can't make the deadline are released before any work is done on them
+static bool admitFrame(GstAppSink *appsink, GstBuffer *buffer) {
+    if (!frame_scheduler || !buffer) {
+        return true;
+    }
+    double age = frameAgeMs(GST_ELEMENT(appsink), buffer);
+    if (frame_scheduler->Admit(age)) {
+        return true;
+    }
+    FlightRecorder::FrameDropped(frameSeq(buffer), age);
+    return false;
+}
+
+static void frameDone(GstAppSink *appsink, GstBuffer *buffer, std::chrono::steady_clock::time_point admitted_at) {
+    AllocTracker::FrameDone();
+    double processing = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - admitted_at).count();
+    if (frame_scheduler) {
+        frame_scheduler->Done(processing);
+    }
+    Tracer::FrameDone();
+    PerfCounters::FrameDone();
+
+    if (FlightRecorder::Enabled()) {
+        double age = frameAgeMs(GST_ELEMENT(appsink), buffer);
+        FlightRecorder::FrameDone(frameSeq(buffer), age >= 0 ? std::max(age - processing, 0.0) : -1, processing,
+            encoder_queue ? encoder_queue->LevelBuffers() : 0, encoder_queue ? encoder_queue->LevelBytes() : 0);
+    }
+}
+
+static void on_sigusr1(int) {
+    FlightRecorder::RequestDump("signal");
+}
+
+// Trace spans of a frame carry its capture sequence number, the capture span runs
+// from the capture time to the frame's arrival here
+static void traceFrame(GstElement *element, GstBuffer *buffer) {
+    if (!Tracer::Enabled()) {
+        return;
+    }
+
+    GstClockTime pts = GST_BUFFER_PTS(buffer);
+    Tracer::SetFrame(frameSeq(buffer));
+
+    // The system clock runs on CLOCK_MONOTONIC like the spans
+    GstClock *clock = gst_element_get_clock(element);
+    if (clock && GST_CLOCK_TIME_IS_VALID(pts)) {
+        Tracer::Record(Stage::Capture, gst_element_get_base_time(element) + pts, MonotonicNs());
+    }
+    if (clock) {
+        gst_object_unref(clock);
+    }
+}
+
+// Encode spans from buffers entering and leaving the encoder, matched by PTS
+static std::mutex encode_starts_mutex;
+static std::map<GstClockTime, int64_t> encode_starts;
+
+static GstPadProbeReturn on_encoder_sink(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (buffer && Tracer::Enabled()) {
+        std::lock_guard<std::mutex> lock(encode_starts_mutex);
+        // Nothing comes out for frames the encoder drops
+        if (encode_starts.size() >= 64) {
+            encode_starts.erase(encode_starts.begin());
+        }
+        encode_starts[GST_BUFFER_PTS(buffer)] = MonotonicNs();
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn on_encoder_src(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (buffer && Tracer::Enabled()) {
+        int64_t start;
+        {
+            std::lock_guard<std::mutex> lock(encode_starts_mutex);
+            auto it = encode_starts.find(GST_BUFFER_PTS(buffer));
+            if (it == encode_starts.end()) {
+                return GST_PAD_PROBE_OK;
+            }
+            start = it->second;
+            encode_starts.erase(it);
+        }
+        Tracer::Record(Stage::Encode, start, MonotonicNs(), frameSeq(buffer));
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+static void traceEncoder(GstElement *encoder) {
+    GstPad *sink = gst_element_get_static_pad(encoder, "sink");
+    GstPad *src = gst_element_get_static_pad(encoder, "src");
+    gst_pad_add_probe(sink, GST_PAD_PROBE_TYPE_BUFFER, on_encoder_sink, NULL, NULL);
+    gst_pad_add_probe(src, GST_PAD_PROBE_TYPE_BUFFER, on_encoder_src, NULL, NULL);
+    gst_object_unref(sink);
+    gst_object_unref(src);
+}
+
+static void reportLatency(GstAppSink *appsink, GstBuffer *buffer, double detectMs) {
+    if (adaptive_ladder) {
+        double age = frameAgeMs(GST_ELEMENT(appsink), buffer);
+        adaptive_ladder->OnFrame(age >= 0 ? age : detectMs);
+    }
+}
+
+// The encoder gets the camera's real frame rate, known once the first sample arrives
+static void setEncoderCaps(GstAppSrc *appsrc, GstSample *sample) {
+    static std::once_flag caps_set;
+    std::call_once(caps_set, [=]() {
+        gint fps_n = 0, fps_d = 1;
+        GstCaps *in_caps = gst_sample_get_caps(sample);
+        if (!in_caps || !gst_structure_get_fraction(gst_caps_get_structure(in_caps, 0), "framerate", &fps_n, &fps_d)) {
+            fps_n = 0;
+            fps_d = 1;
+        }
+
+        GstCaps *caps = gst_app_src_get_caps(appsrc);
+        GstCaps *out_caps = gst_caps_copy(caps);
+        gst_caps_set_simple(out_caps, "framerate", GST_TYPE_FRACTION, fps_n, fps_d, NULL);
+        gst_app_src_set_caps(appsrc, out_caps);
+        gst_caps_unref(out_caps);
+        gst_caps_unref(caps);
+    });
+}
+
+// Hands an annotated frame over to the encoder
+static void pushFrame(GstAppSink *appsink, GstElement *appsrc, GstSample *sample, GstBuffer *buffer_out,
+                      std::chrono::steady_clock::time_point admitted_at) {
+    setEncoderCaps(GST_APP_SRC(appsrc), sample);
+    GstFlowReturn ret;
+    {
+        ODETECT_STAGE(Stage::Push);
+        ret = encoder_queue->Push(buffer_out);
+    }
+    frame_scheduler->SetDropped(FrameScheduler::DropReason::EncoderQueue, encoder_queue->Dropped());
+    if (ret != GST_FLOW_OK) {
+        std::cerr << "Error during sending frame to video codec: " << gst_flow_get_name(ret) << std::endl;
+    } else {
+        reportFirstFrame();
+    }
+    frameDone(appsink, gst_sample_get_buffer(sample), admitted_at);
+}
 
 static GstFlowReturn on_new_sample(GstAppSink *appsink, gpointer user_data) {
     GstSample *sample = gst_app_sink_pull_sample(appsink);
 
     if (sample) {
         GstBuffer *buffer_in = gst_sample_get_buffer(sample);
-        GstBuffer *buffer_out = gst_buffer_new_allocate(nullptr, 640*480*3, nullptr);
-        if (!buffer_in || !buffer_out) {
+        if (!buffer_in || !admitFrame(appsink, buffer_in)) {
+            gst_sample_unref(sample);
+            return GST_FLOW_OK;
+        }
+        auto admitted_at = std::chrono::steady_clock::now();
+        AllocTracker::FrameBegin();
+        traceFrame(GST_ELEMENT(appsink), buffer_in);
+        // From here on every exit closes the frame, and the pooled buffer goes either to
+        // the encoder or back to the pool
+        GstBuffer *buffer_out = nullptr;
+        if (gst_buffer_pool_acquire_buffer(out_pool, &buffer_out, nullptr) != GST_FLOW_OK) {
             std::cerr << "Can't allocate gstreamer buffer" << std::endl;
-            goto exit;
+            frameDone(appsink, buffer_in, admitted_at);
+            gst_sample_unref(sample);
+            return GST_FLOW_OK;
         }
+        // Capture PTS goes on to the encoder and RTP, see FrameLineage
+        gst_buffer_copy_into(buffer_out, buffer_in, GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
         GstMapInfo mapIn, mapOut;
+        bool push = false;
+
+        if (gst_buffer_map(buffer_in, &mapIn, GST_MAP_READ)) {
+            if (gst_buffer_map(buffer_out, &mapOut, GST_MAP_WRITE)) {
+                push = true;
+                try {
+                    auto detector = detector_slot->Get();
+                    auto start = std::chrono::high_resolution_clock::now();
+                    bool result = detector->Detect(mapIn.data, mapOut.data);
+                    auto end = std::chrono::high_resolution_clock::now();
+                    reportLatency(appsink, buffer_in, std::chrono::duration<double, std::milli>(end - start).count());
+                    if (!result) {
+                        std::cerr << "Can't detect any objects" << std::endl;
+                        push = false;
+                    }
+                } catch (std::exception& e) {
+                    std::cerr << "Detector error: " << e.what() << std::endl;
+                }
+                gst_buffer_unmap(buffer_out, &mapOut);
+            }
+            gst_buffer_unmap(buffer_in, &mapIn);
+        }
+
+        if (push) {
+            pushFrame(appsink, (GstElement *)user_data, sample, buffer_out, admitted_at);
+        } else {
+            gst_buffer_unref(buffer_out);
+            frameDone(appsink, buffer_in, admitted_at);
+        }
+        gst_sample_unref(sample);
+    }
+
+    return GST_FLOW_OK;
+}
+
+// An annotated frame in flight through the pipelined detector
+struct FrameJob : PipelinedDetector::Job {
+    GstAppSink *appsink = nullptr;
+    GstElement *appsrc = nullptr;
+    GstSample *sample = nullptr;
+    GstBuffer *buffer_out = nullptr;
+    GstMapInfo map_out;
+    std::chrono::steady_clock::time_point admitted_at;
+};
+
+// Prepares the frame on the streaming thread, the pipeline threads detect and push it
+static GstFlowReturn on_new_sample_pipelined(GstAppSink *appsink, gpointer user_data) {
+    GstSample *sample = gst_app_sink_pull_sample(appsink);
+    if (!sample) {
+        return GST_FLOW_OK;
+    }
+
+    GstBuffer *buffer_in = gst_sample_get_buffer(sample);
+    if (!buffer_in || !admitFrame(appsink, buffer_in)) {
+        gst_sample_unref(sample);
+        return GST_FLOW_OK;
+    }
+    auto admitted_at = std::chrono::steady_clock::now();
+    AllocTracker::FrameBegin();
+    traceFrame(GST_ELEMENT(appsink), buffer_in);
+
+    GstBuffer *buffer_out = nullptr;
+    if (gst_buffer_pool_acquire_buffer(out_pool, &buffer_out, nullptr) != GST_FLOW_OK) {
+        std::cerr << "Can't allocate gstreamer buffer" << std::endl;
+        frameDone(appsink, buffer_in, admitted_at);
+        gst_sample_unref(sample);
+        return GST_FLOW_OK;
+    }
+    gst_buffer_copy_into(buffer_out, buffer_in, GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+
+    GstMapInfo map_in, map_out;
+    if (!gst_buffer_map(buffer_in, &map_in, GST_MAP_READ)) {
+        gst_buffer_unref(buffer_out);
+        frameDone(appsink, buffer_in, admitted_at);
+        gst_sample_unref(sample);
+        return GST_FLOW_OK;
+    }
+    if (!gst_buffer_map(buffer_out, &map_out, GST_MAP_WRITE)) {
+        gst_buffer_unmap(buffer_in, &map_in);
+        gst_buffer_unref(buffer_out);
+        frameDone(appsink, buffer_in, admitted_at);
+        gst_sample_unref(sample);
+        return GST_FLOW_OK;
+    }
 
+    // Waits while the pipeline is full, which holds the capture back
+    FrameJob *job = static_cast<FrameJob *>(frame_pipeline->Begin());
+    job->appsink = appsink;
+    job->appsrc = (GstElement *)user_data;
+    job->sample = sample;
+    job->buffer_out = buffer_out;
+    job->map_out = map_out;
+    job->admitted_at = admitted_at;
+    job->seq = frameSeq(buffer_in);
+    frame_pipeline->Submit(job, detector_slot->Get(), map_in.data, map_out.data);
+
+    // The input is copied by now, the sample stays with the job for its timestamps
+    gst_buffer_unmap(buffer_in, &map_in);
+    return GST_FLOW_OK;
+}
+
+// Runs on the finishing thread of the pipeline, in frame order
+static void on_frame_pipelined(PipelinedDetector::Job &pipeline_job) {
+    FrameJob &job = static_cast<FrameJob &>(pipeline_job);
+    double detect_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job.admitted_at).count();
+    reportLatency(job.appsink, gst_sample_get_buffer(job.sample), detect_ms);
+    if (!job.error.empty()) {
+        std::cerr << "Detector error: " << job.error << std::endl;
+    }
+
+    gst_buffer_unmap(job.buffer_out, &job.map_out);
+    pushFrame(job.appsink, job.appsrc, job.sample, job.buffer_out, job.admitted_at);
+    gst_sample_unref(job.sample);
+    job.sample = nullptr;
+    job.buffer_out = nullptr;
+}
+
+// H264 passthrough: the camera bitstream goes to RTP as is, only detections are produced here
+static GstFlowReturn on_new_sample_meta(GstAppSink *appsink, gpointer user_data) {
+    static uint64_t frame_seq = 0;
+    GstSample *sample = gst_app_sink_pull_sample(appsink);
 
-        if (gst_buffer_map(buffer_in, &mapIn, GST_MAP_READ) && gst_buffer_map(buffer_out, &mapOut, GST_MAP_WRITE)) {
+    if (sample) {
+        GstBuffer *buffer_in = gst_sample_get_buffer(sample);
+        GstMapInfo mapIn;
+
+        if (!buffer_in || !admitFrame(appsink, buffer_in)) {
+            frame_seq++;
+            gst_sample_unref(sample);
+            return GST_FLOW_OK;
+        }
+        auto admitted_at = std::chrono::steady_clock::now();
+        AllocTracker::FrameBegin();
+        traceFrame(GST_ELEMENT(appsink), buffer_in);
+
+        if (gst_buffer_map(buffer_in, &mapIn, GST_MAP_READ)) {
             try {
-                auto start = std::chrono::high_resolution_clock::now();
-                bool result = detector->Detect(mapIn.data, mapOut.data);
-                auto end = std::chrono::high_resolution_clock::now();
-                auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
-                if (!result) {
-                    std::cerr << "Can't detect any objects" << std::endl;
-                    goto unmap;
+                std::vector<ODDetection> detections;
+                auto start = std::chrono::steady_clock::now();
+                bool result = detector_slot->Get()->Detect(mapIn.data, detections);
+                reportLatency(appsink, buffer_in,
+                    std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                if (result) {
+                    // Same numbering as the RTP frame sequence extension when the frame is still known
+                    uint32_t capture_seq;
+                    uint64_t seq = frame_lineage.Lookup(GST_BUFFER_PTS(buffer_in), capture_seq) ? capture_seq : frame_seq;
+                    DetectionMetaSender *sender = (DetectionMetaSender *)user_data;
+                    if (!sender->Send(seq, GST_BUFFER_PTS(buffer_in), detections)) {
+                        std::cerr << "Error during sending detection metadata" << std::endl;
+                    } else {
+                        reportFirstFrame();
+                    }
                 }
             } catch (std::exception& e) {
                 std::cerr << "Detector error: " << e.what() << std::endl;
             }
-
-            GstElement *appsrc = (GstElement *)user_data;
-            GstFlowReturn ret = gst_app_src_push_buffer(GST_APP_SRC(appsrc), buffer_out);
-            if (ret != GST_FLOW_OK) {
-                std::cerr << "Error during sending frame to video codec" << std::endl;
-            }
+            gst_buffer_unmap(buffer_in, &mapIn);
         }
-unmap:
-        gst_buffer_unmap(buffer_in, &mapIn);
-        gst_buffer_unmap(buffer_out, &mapOut);
-exit:
+        frameDone(appsink, buffer_in, admitted_at);
+        frame_seq++;
         gst_sample_unref(sample);
     }
 
     return GST_FLOW_OK;
 }
 
+// Keyframe sampling for the inference branch: delta units are dropped before the decoder
+static GstPadProbeReturn drop_delta_units(GstPad *pad, GstPadProbeInfo *info, gpointer user_data) {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+    if (buffer && GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT)) {
+        return GST_PAD_PROBE_DROP;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
 static void printSupportedModels() {
     auto models = ModelFactory::factory;
     for (const auto& modelUnit : models) {
@@ -92,14 +453,79 @@ static void printSupportedModels() {
     }
 }
 
+static void printSupportedBackends() {
+    for (const auto& backendUnit : BackendFactory::factory) {
+        std::cout << "  " << backendUnit.first << std::endl;
+    }
+}
+
+// Per model options are either a single value or a list of <model>:<value> pairs
+static std::string valueForModel(const std::string& spec, const std::string& model_name, std::string fallback) {
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        auto sep = item.find(':');
+        if (sep == std::string::npos) {
+            fallback = item;
+        } else if (item.substr(0, sep) == model_name) {
+            return item.substr(sep + 1);
+        }
+    }
+    return fallback;
+}
+
 int main(int argc, char* argv[]) {
+    process_start = std::chrono::steady_clock::now();
+
     std::string model_dir;
     std::string model_name;
     float conf_threshold;
+    std::string backend_spec;
+    std::string precision_spec;
+    std::string precision_guard;
+    bool precision_unguarded;
+    BackendParams backend_params;
     int video_id;
     std::string dst_ip;
     std::string dst_port;
+    std::string meta_port;
     std::string video_device = "/dev/video";
+    bool h264_passthrough;
+    int infer_width;
+    int infer_height;
+    bool infer_keyframes_only;
+    int warmup;
+    int contexts;
+    bool pipeline;
+    int threads;
+    int encoder_threads;
+    std::string control_socket;
+    std::string roi_spec;
+    bool tiling;
+    int tile_size;
+    float tile_overlap;
+    float motion_sensitivity;
+    bool refine;
+    float refine_threshold;
+    int refine_max;
+    std::vector<AdaptiveLadder::Rung> ladder;
+    double latency_budget;
+    double frame_deadline;
+    int latency_probe_port;
+    EncoderQueue::Policy encoder_policy;
+    int encoder_max_buffers;
+    int encoder_max_mb;
+    int motion_max_skip;
+    std::string trace_path;
+    double trace_seconds;
+    int trace_frames;
+    std::string flight_dir;
+    int flight_frames;
+    double flight_threshold;
+    bool perf_counters;
+    double perf_report;
+    int alloc_check;
+    bool alloc_report;
 
     try {
         cxxopts::Options options("odetect", "Detection of objects based on DNN");
@@ -111,14 +537,65 @@ int main(int argc, char* argv[]) {
             ("v,video_device", "Video Device ID", cxxopts::value<int>())
             ("dst_ip", "Destination IP", cxxopts::value<std::string>())
             ("dst_port", "Destination Port", cxxopts::value<std::string>()->default_value("5000"))
+            ("h264_passthrough", "Forward the camera H264 bitstream without re-encoding, detections go to --meta_port")
+            ("meta_port", "Destination Port for detection metadata (JSON over UDP) in passthrough mode", cxxopts::value<std::string>()->default_value("5001"))
+            ("infer_width", "Inference frame width in passthrough mode", cxxopts::value<int>()->default_value("640"))
+            ("infer_height", "Inference frame height in passthrough mode (0 - keep camera aspect)", cxxopts::value<int>()->default_value("0"))
+            ("infer_keyframes_only", "Decode and detect keyframes only in passthrough mode")
+            ("backend", "Inference backend, or per model list <model>:<backend>,...", cxxopts::value<std::string>()->default_value("opencv"))
+            ("precision", "Inference precision fp32|fp16|int8, or per model list <model>:<precision>,...", cxxopts::value<std::string>()->default_value("fp32"))
+            ("precision_guard", "Verdicts of odetect-validate (default <model_directory>/precision.guard)", cxxopts::value<std::string>())
+            ("precision_unguarded", "Allow fp16/int8 without an accepted odetect-validate verdict")
+            ("cache_dir", "Compiled model cache (default <model_directory>/cache)", cxxopts::value<std::string>())
+            ("no_model_cache", "Don't read or write the compiled model cache")
+            ("ort_opt_level", "onnxruntime graph optimization level: disable|basic|extended|all", cxxopts::value<std::string>()->default_value("all"))
+            ("ort_intra_threads", "onnxruntime intra-op threads (0 - default)", cxxopts::value<int>()->default_value("0"))
+            ("ort_inter_threads", "onnxruntime inter-op threads (0 - default)", cxxopts::value<int>()->default_value("0"))
+            ("ort_no_arena", "Disable onnxruntime CPU memory arena")
+            ("tflite_threads", "tflite/XNNPACK threads (0 - all cores)", cxxopts::value<int>()->default_value("0"))
+            ("profile_layers", "Print per layer forward times over this many forward passes, for each loaded model and input size (0 - off)", cxxopts::value<int>()->default_value("0"))
+            ("warmup", "Warm-up forward passes before the stream starts", cxxopts::value<int>()->default_value("1"))
+            ("pipeline", "Overlap preprocessing, forward pass and decoding of consecutive frames on three threads, one to two frames more latency")
+            ("contexts", "Forward passes of a model run at once, for tiles and refinement windows. onnxruntime and tflite only", cxxopts::value<int>()->default_value("1"))
+            ("threads", "Workers of the task executor shared by OpenCV's parallel loops and the forward passes (0 - cores - 1, -1 - OpenCV's own pool)", cxxopts::value<int>()->default_value("0"))
+            ("encoder_threads", "x264enc threads (0 - x264 picks)", cxxopts::value<int>()->default_value("0"))
+            ("control_socket", "UNIX socket for runtime threshold/model changes (off by default)", cxxopts::value<std::string>()->default_value(""))
+            ("roi", "Detection zones in camera pixels: x,y,w,h or x1,y1,x2,y2,x3,y3[,...], separated by ';'", cxxopts::value<std::string>())
+            ("roi_file", "File with detection zones, one per line", cxxopts::value<std::string>())
+            ("tiles", "Detect on overlapping tiles of the frame (or ROI) for small objects on high resolution cameras")
+            ("tile_size", "Tile size in frame pixels (0 - model input size)", cxxopts::value<int>()->default_value("0"))
+            ("tile_overlap", "Tile overlap [0..1)", cxxopts::value<float>()->default_value("0.25"))
+            ("refine", "Coarse to fine: full frame pass, then full resolution passes around small or weak candidates")
+            ("refine_threshold", "Minimal confidence of a refinement candidate (0..1]", cxxopts::value<float>()->default_value("0.3"))
+            ("refine_max", "Refined candidates per frame at most", cxxopts::value<int>()->default_value("8"))
+            ("motion_gate", "Skip inference while less than this part of the frame (0..1] changes, 0 - off", cxxopts::value<float>()->default_value("0"))
+            ("motion_max_skip", "Frames skipped at most in a row by the motion gate", cxxopts::value<int>()->default_value("30"))
+            ("ladder", "Models to step along under load, most accurate first: <model>[@<input size>],...", cxxopts::value<std::string>())
+            ("latency_budget", "Frame latency budget for --ladder, ms", cxxopts::value<double>()->default_value("66"))
+            ("frame_deadline", "Drop frames that can't be done within this time from capture, ms (0 - off)", cxxopts::value<double>()->default_value("0"))
+            ("latency_probe_port", "Also send the RTP stream to 127.0.0.1:<port> for odetect-latency-probe (0 - off)", cxxopts::value<int>()->default_value("0"))
+            ("encoder_policy", "Full encoder queue: block|drop-oldest|drop-newest", cxxopts::value<std::string>()->default_value("drop-oldest"))
+            ("encoder_max_buffers", "Frames queued for the encoder at most", cxxopts::value<int>()->default_value("4"))
+            ("encoder_max_mb", "Encoder queue size limit, MB (0 - only --encoder_max_buffers)", cxxopts::value<int>()->default_value("0"))
+            ("trace", "Write a Chrome JSON trace of the frame stages to this file (chrome://tracing, ui.perfetto.dev)", cxxopts::value<std::string>())
+            ("trace_seconds", "Trace duration, s (0 - --trace_frames only)", cxxopts::value<double>()->default_value("10"))
+            ("trace_frames", "Frames traced at most (0 - --trace_seconds only)", cxxopts::value<int>()->default_value("0"))
+            ("flight_frames", "Frames kept by the flight recorder (0 - off)", cxxopts::value<int>()->default_value("4096"))
+            ("flight_threshold", "Dump the flight recorder when a frame takes longer from capture, ms (0 - off)", cxxopts::value<double>()->default_value("1000"))
+            ("flight_dir", "Directory for flight recorder dumps (also written on SIGUSR1 and GStreamer errors)", cxxopts::value<std::string>()->default_value("/tmp"))
+            ("perf_counters", "Count cycles, instructions, cache and branch misses and CPU time per stage (perf_event_open)")
+            ("perf_report", "Period of the --perf_counters report, s (0 - on exit only)", cxxopts::value<double>()->default_value("10"))
+            ("alloc_report", "Count heap allocations of the frame path per stage, reported with --perf_report period (ODETECT_ALLOC_TRACKING builds)")
+            ("alloc_check", "Exit after this many steady state frames, with status 1 if any of them allocated in the copy, decode or draw stages (ODETECT_ALLOC_TRACKING builds, 0 - off)", cxxopts::value<int>()->default_value("0"))
             ("l", "List models")
+            ("list_backends", "List inference backends")
             ("h,help", "Print usage");
 
         auto result = options.parse(argc, argv);
 
         if (result.count("help")) {
             std::cout << "Usage:\n  odetect -v <video_device> --dst_ip <destination_ip> [OPTION...]\n";
-            std::cout << "Warning: video output is only RTP/H264 (program encoded)\n\n";
+            std::cout << "Warning: video output is only RTP/H264 (program encoded, or camera's own with --h264_passthrough)\n\n";
             std::cout << options.help() << std::endl;
             return 0;
         }
@@ -128,6 +605,11 @@ int main(int argc, char* argv[]) {
             return 0;
         }
 
+        if (result.count("list_backends")) {
+            printSupportedBackends();
+            return 0;
+        }
+
         if (!result.count("video_device") || !result.count("dst_ip")) {
             std::cerr << "Error: Video Device ID and Destination IP are mandatory." << std::endl;
             std::cout << options.help() << std::endl;
@@ -137,10 +619,106 @@ int main(int argc, char* argv[]) {
         model_dir = result["model_directory"].as<std::string>();
         model_name = result["name"].as<std::string>();
         conf_threshold = result["threshold"].as<float>();
+        backend_spec = result["backend"].as<std::string>();
+        precision_spec = result["precision"].as<std::string>();
+        precision_guard = result.count("precision_guard") ? result["precision_guard"].as<std::string>()
+            : model_dir + "/precision.guard";
+        precision_unguarded = result.count("precision_unguarded") > 0;
+        backend_params.cacheDir = result.count("no_model_cache") ? ""
+            : result.count("cache_dir") ? result["cache_dir"].as<std::string>() : model_dir + "/cache";
+        backend_params.ortOptLevel = result["ort_opt_level"].as<std::string>();
+        backend_params.ortIntraOpThreads = result["ort_intra_threads"].as<int>();
+        backend_params.ortInterOpThreads = result["ort_inter_threads"].as<int>();
+        backend_params.ortArena = result.count("ort_no_arena") == 0;
+        backend_params.tfliteThreads = result["tflite_threads"].as<int>();
+        backend_params.profileLayers = result["profile_layers"].as<int>();
         int video_device_id = result["video_device"].as<int>();
         video_device += std::to_string(video_device_id);
         dst_ip = result["dst_ip"].as<std::string>();
         dst_port = result["dst_port"].as<std::string>();
+        meta_port = result["meta_port"].as<std::string>();
+        h264_passthrough = result.count("h264_passthrough") > 0;
+        infer_width = result["infer_width"].as<int>();
+        infer_height = result["infer_height"].as<int>();
+        infer_keyframes_only = result.count("infer_keyframes_only") > 0;
+        warmup = result["warmup"].as<int>();
+        pipeline = result.count("pipeline") > 0;
+        if (pipeline && h264_passthrough) {
+            std::cerr << "Error: --pipeline needs re-encoded output, not --h264_passthrough." << std::endl;
+            return 1;
+        }
+        contexts = result["contexts"].as<int>();
+        if (contexts < 1) {
+            std::cerr << "Error: --contexts must be >= 1." << std::endl;
+            return 1;
+        }
+        threads = result["threads"].as<int>();
+        if (threads < -1) {
+            std::cerr << "Error: --threads must be >= -1." << std::endl;
+            return 1;
+        }
+        encoder_threads = result["encoder_threads"].as<int>();
+        if (encoder_threads < 0) {
+            std::cerr << "Error: --encoder_threads must be >= 0." << std::endl;
+            return 1;
+        }
+        control_socket = result["control_socket"].as<std::string>();
+        tiling = result.count("tiles") > 0;
+        tile_size = result["tile_size"].as<int>();
+        tile_overlap = result["tile_overlap"].as<float>();
+        refine = result.count("refine") > 0;
+        refine_threshold = result["refine_threshold"].as<float>();
+        refine_max = result["refine_max"].as<int>();
+        if (tiling && refine) {
+            std::cerr << "Error: --tiles and --refine are exclusive." << std::endl;
+            return 1;
+        }
+        if (result.count("ladder")) {
+            ladder = AdaptiveLadder::ParseLadder(result["ladder"].as<std::string>());
+            model_name = ladder.front().model;
+        }
+        latency_budget = result["latency_budget"].as<double>();
+        frame_deadline = result["frame_deadline"].as<double>();
+        latency_probe_port = result["latency_probe_port"].as<int>();
+        encoder_policy = EncoderQueue::ParsePolicy(result["encoder_policy"].as<std::string>());
+        encoder_max_buffers = result["encoder_max_buffers"].as<int>();
+        encoder_max_mb = result["encoder_max_mb"].as<int>();
+        if (encoder_max_buffers <= 0 || encoder_max_mb < 0) {
+            std::cerr << "Error: incorrect encoder queue limits." << std::endl;
+            return 1;
+        }
+        motion_sensitivity = result["motion_gate"].as<float>();
+        motion_max_skip = result["motion_max_skip"].as<int>();
+        if (result.count("trace")) {
+            trace_path = result["trace"].as<std::string>();
+        }
+        trace_seconds = result["trace_seconds"].as<double>();
+        trace_frames = result["trace_frames"].as<int>();
+        if (trace_seconds < 0 || trace_frames < 0 || (!trace_seconds && !trace_frames)) {
+            std::cerr << "Error: incorrect trace limits." << std::endl;
+            return 1;
+        }
+        perf_counters = result.count("perf_counters") > 0;
+        perf_report = result["perf_report"].as<double>();
+        alloc_report = result.count("alloc_report") > 0;
+        alloc_check = result["alloc_check"].as<int>();
+        if ((alloc_report || alloc_check) && !AllocTracker::Available()) {
+            std::cerr << "Error: allocation tracking needs odetect built with ODETECT_ALLOC_TRACKING." << std::endl;
+            return 1;
+        }
+        flight_dir = result["flight_dir"].as<std::string>();
+        flight_frames = result["flight_frames"].as<int>();
+        flight_threshold = result["flight_threshold"].as<double>();
+        if (flight_frames < 0 || flight_threshold < 0) {
+            std::cerr << "Error: incorrect flight recorder options." << std::endl;
+            return 1;
+        }
+        if (result.count("roi")) {
+            roi_spec = result["roi"].as<std::string>();
+        }
+        if (result.count("roi_file")) {
+            roi_spec += ";" + RoiMask::ReadSpec(result["roi_file"].as<std::string>());
+        }
     } catch (const std::exception& e) {
         std::cerr << "Error parsing options: " << e.what() << std::endl;
         return 1;
@@ -149,46 +727,237 @@ int main(int argc, char* argv[]) {
     std::chrono::milliseconds timeout(500);
 
     ODCaps inCaps;
-    if (GetOdCapsFromVideoDev(video_device.c_str(), &inCaps)) {
+    ODCaps streamCaps;
+    if (h264_passthrough) {
+        if (GetOdH264CapsFromVideoDev(video_device.c_str(), &streamCaps)) {
+            std::cerr << "Can't get H264 caps for device: " << video_device << std::endl;
+            return -1;
+        }
+        if (infer_width <= 0 || infer_height < 0) {
+            std::cerr << "Incorrect inference frame size" << std::endl;
+            return -1;
+        }
+        if (!infer_height) {
+            infer_height = streamCaps.height * infer_width / streamCaps.width;
+        }
+        // Keep BGR rows free of stride padding
+        inCaps.width = (infer_width + 3) & ~3;
+        inCaps.height = (infer_height + 1) & ~1;
+        inCaps.pformat = V4L2_PIX_FMT_BGR24;
+        inCaps.channels = 3;
+    } else if (GetOdCapsFromVideoDev(video_device.c_str(), &inCaps)) {
         std::cerr << "Can't get caps for device: " << video_device << std::endl;
         return -1;
     }
+    out_frame_size = inCaps.width * inCaps.height * 3;
 
-    try {
-        auto model_unit = ModelFactory::factory.find(model_name);
-        if (model_unit == ModelFactory::factory.end()) {
-            std::cerr << "Incorrect model name. Call odetect -l\n";
+    if (ModelFactory::factory.find(model_name) == ModelFactory::factory.end()) {
+        std::cerr << "Incorrect model name. Call odetect -l\n";
+        return -1;
+    }
+    for (const auto& rung : ladder) {
+        if (ModelFactory::factory.find(rung.model) == ModelFactory::factory.end()) {
+            std::cerr << "Incorrect model name in the ladder: " << rung.model << ". Call odetect -l\n";
+            return -1;
+        }
+    }
+
+    std::shared_ptr<const RoiMask> roi;
+    if (!roi_spec.empty()) {
+        try {
+            cv::Size camera_size = h264_passthrough ? cv::Size(streamCaps.width, streamCaps.height) : cv::Size(inCaps.width, inCaps.height);
+            roi = std::make_shared<RoiMask>(roi_spec, camera_size, cv::Size(inCaps.width, inCaps.height));
+        } catch (std::exception& e) {
+            std::cerr << "Incorrect ROI: " << e.what() << std::endl;
+            return -1;
+        }
+        const cv::Rect& bounds = roi->Bounds();
+        std::cout << "ROI: " << roi->Zones().size() << " zone(s), inferring " << bounds.width << "x" << bounds.height
+                  << "+" << bounds.x << "+" << bounds.y << std::endl;
+    }
+
+    // Before the first model loads, its warm-up already runs on the pool
+    if (threads >= 0) {
+        TaskExecutor::Start(threads);
+        std::cout << "Task executor: " << TaskExecutor::Shared()->Threads() << " worker(s)" << std::endl;
+    }
+
+    // Resolves per model options for the initial model and for runtime model swaps
+    auto resolve_params = [=](const std::string& name) {
+        // By name, a field added to DetectorParams can't shift the others
+        DetectorParams params;
+        params.threshold = conf_threshold;
+        params.backend = backend_params;
+        params.roi = roi;
+        params.tiling = tiling;
+        params.tileSize = tile_size;
+        params.tileOverlap = tile_overlap;
+        params.motionSensitivity = motion_sensitivity;
+        params.motionMaxSkip = motion_max_skip;
+        params.refine = refine;
+        params.refineThreshold = refine_threshold;
+        params.refineMax = refine_max;
+        params.contexts = contexts;
+        params.backend.name = valueForModel(backend_spec, name, "opencv");
+        std::string precision = valueForModel(precision_spec, name, "fp32");
+        params.backend.precision = ParsePrecision(precision);
+        // Every opencv context is a net with a copy of the weights, and its layers run in
+        // parallel on the task executor already
+        if (params.contexts > 1 && params.backend.name == "opencv") {
+            std::cerr << "Warning: --contexts " << params.contexts << " ignored for " << name
+                      << " on opencv, each context would hold a copy of the weights" << std::endl;
+            params.contexts = 1;
+        }
+
+        if (params.backend.precision != Precision::FP32 && !precision_unguarded &&
+            !PrecisionGuard(precision_guard).IsAccepted(name, params.backend.name, precision)) {
+            throw std::runtime_error(precision + " " + name + " on " + params.backend.name + " has no accepted verdict in "
+                + precision_guard + ". Run odetect-validate first");
+        }
+        return params;
+    };
+    detector_slot = std::make_unique<DetectorSlot>(model_dir, inCaps, resolve_params, warmup);
+
+    // The model loads and warms up while GStreamer and the pipelines are set up
+    int input_size = ladder.empty() ? 0 : ladder.front().inputSize;
+    std::future<DetectorSlot::LoadTiming> detector_loading = std::async(std::launch::async, [model_name, input_size]() {
+        return detector_slot->Load(model_name, 0, input_size);
+    });
+
+    gst_init(nullptr, nullptr);
+
+    GstElement *pipeline_capture = nullptr;
+    GstElement *pipeline_encode = nullptr;
+    GstElement *appsink = nullptr;
+    std::unique_ptr<DetectionMetaSender> meta_sender;
+
+    // RTP egress, optionally duplicated to a local latency probe
+    std::string rtp_sink_str = latency_probe_port > 0
+        ? "multiudpsink clients=" + dst_ip + ":" + dst_port + ",127.0.0.1:" + std::to_string(latency_probe_port) + " sync=false"
+        : "udpsink host=" + dst_ip + " port=" + dst_port + " sync=false";
+
+    if (h264_passthrough) {
+        try {
+            meta_sender = std::make_unique<DetectionMetaSender>(dst_ip, meta_port, inCaps, streamCaps);
+        } catch (std::exception& e) {
+            std::cerr << "Can't create metadata sender: " << e.what() << std::endl;
             return -1;
         }
-        auto constructFunc = model_unit->second;
-        detector = constructFunc(model_dir, inCaps, &conf_threshold);
+
+        std::string pipeline_capture_str = "v4l2src name=camera device=" + video_device + " ! video/x-h264,width=" + std::to_string(streamCaps.width)
+            + ",height=" + std::to_string(streamCaps.height) + " ! h264parse config-interval=-1 ! tee name=t"
+            + " t. ! queue ! rtph264pay name=pay config-interval=1 pt=96 ! " + rtp_sink_str
+            + " t. ! queue name=inferq leaky=downstream max-size-buffers=2 ! avdec_h264 ! videoscale ! videoconvert"
+            + " ! video/x-raw,format=BGR,width=" + std::to_string(inCaps.width) + ",height=" + std::to_string(inCaps.height)
+            + " ! appsink name=mysink max-buffers=1 drop=true";
+        pipeline_capture = gst_parse_launch(pipeline_capture_str.c_str(), NULL);
+        std::cout << "Passthrough pipeline: " << pipeline_capture_str << std::endl;
+
+        if (infer_keyframes_only) {
+            GstElement *inferq = gst_bin_get_by_name(GST_BIN(pipeline_capture), "inferq");
+            GstPad *pad = gst_element_get_static_pad(inferq, "sink");
+            gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, drop_delta_units, NULL, NULL);
+            gst_object_unref(pad);
+            gst_object_unref(inferq);
+        }
+
+        appsink = gst_bin_get_by_name(GST_BIN(pipeline_capture), "mysink");
+        g_object_set(appsink, "emit-signals", TRUE, "sync", FALSE, NULL);
+        g_signal_connect(appsink, "new-sample", G_CALLBACK(on_new_sample_meta), meta_sender.get());
+    } else {
+        std::string pipeline_capture_str = "v4l2src name=camera device=" + video_device + " ! video/x-raw ! appsink name=mysink";
+        pipeline_capture = gst_parse_launch(pipeline_capture_str.c_str(), NULL);
+        std::cout << "Capture pipeline: " << pipeline_capture_str << std::endl;
+
+        // Frames keep their capture PTS, the frame rate is set from the camera caps on the first frame
+        std::string pipeline_encode_str = "appsrc name=source is-live=true format=time caps=video/x-raw,width=" + std::to_string(inCaps.width)
+            + ",height=" + std::to_string(inCaps.height) + ",format=BGR ! videoconvert ! x264enc name=encoder threads=" + std::to_string(encoder_threads) + " tune=zerolatency speed-preset=superfast key-int-max=15 ! h264parse ! rtph264pay name=pay config-interval=1 pt=96 ! " + rtp_sink_str;
+        pipeline_encode = gst_parse_launch(
+            pipeline_encode_str.c_str(),
+            NULL
+        );
+
+        std::cout << "Encode pipeline: " << pipeline_encode_str << std::endl;
+
+        GstElement *appsrc = gst_bin_get_by_name(GST_BIN(pipeline_encode), "source");
+        appsink = gst_bin_get_by_name(GST_BIN(pipeline_capture), "mysink");
+        encoder_queue = std::make_unique<EncoderQueue>(GST_APP_SRC(appsrc), encoder_policy,
+            static_cast<uint64_t>(encoder_max_mb) << 20, encoder_max_buffers);
+
+        // Enough for a full encoder queue and the frames in flight, more are added on demand
+        out_pool = gst_buffer_pool_new();
+        GstStructure *pool_config = gst_buffer_pool_get_config(out_pool);
+        gst_buffer_pool_config_set_params(pool_config, nullptr, out_frame_size, encoder_max_buffers + (pipeline ? 6 : 4), 0);
+        if (!gst_buffer_pool_set_config(out_pool, pool_config) || !gst_buffer_pool_set_active(out_pool, TRUE)) {
+            std::cerr << "Can't allocate frame buffer pool" << std::endl;
+            return -1;
+        }
+
+        g_object_set(appsink, "emit-signals", TRUE, "sync", FALSE, NULL);
+        if (pipeline) {
+            frame_pipeline = std::make_unique<PipelinedDetector>([]() { return std::make_unique<FrameJob>(); }, on_frame_pipelined);
+            g_signal_connect(appsink, "new-sample", G_CALLBACK(on_new_sample_pipelined), appsrc);
+        } else {
+            g_signal_connect(appsink, "new-sample", G_CALLBACK(on_new_sample), appsrc);
+        }
+
+        if (!trace_path.empty()) {
+            GstElement *encoder = gst_bin_get_by_name(GST_BIN(pipeline_encode), "encoder");
+            traceEncoder(encoder);
+            gst_object_unref(encoder);
+        }
+    }
+
+    GstElement *camera = gst_bin_get_by_name(GST_BIN(pipeline_capture), "camera");
+    GstElement *payloader = gst_bin_get_by_name(GST_BIN(pipeline_encode ? pipeline_encode : pipeline_capture), "pay");
+    frame_lineage.AttachCapture(camera);
+    frame_lineage.AttachEgress(payloader);
+    gst_object_unref(camera);
+    gst_object_unref(payloader);
+
+    try {
+        DetectorSlot::LoadTiming timing = detector_loading.get();
+        std::cout << "Model loaded in " << timing.loadMs << " ms, warm-up (" << warmup << " passes): "
+                  << timing.warmUpMs << " ms" << std::endl;
     } catch (std::exception& e) {
         std::cerr << "Can't allocate detector model: " << e.what() << std::endl;
         return -1;
     }
 
-    gst_init(nullptr, nullptr);
-
-    std::string pipeline_capture_str = "v4l2src device=" + video_device + " ! video/x-raw ! appsink name=mysink";
-    GstElement *pipeline_capture = gst_parse_launch(pipeline_capture_str.c_str(), NULL);
-    std::cout << "Capture pipeline: " << pipeline_capture_str << std::endl;
+    if (!ladder.empty()) {
+        try {
+            adaptive_ladder = std::make_unique<AdaptiveLadder>(*detector_slot, ladder, latency_budget);
+        } catch (std::exception& e) {
+            std::cerr << "Can't start adaptive ladder: " << e.what() << std::endl;
+            return -1;
+        }
+    }
 
-    std::string pipeline_encode_str = "appsrc name=source caps=video/x-raw,width=" + std::to_string(inCaps.width)
-        + ",height=" + std::to_string(inCaps.height) + ",framerate=30/1,format=BGR ! videoconvert ! x264enc tune=zerolatency speed-preset=superfast key-int-max=15 ! h264parse ! rtph264pay config-interval=1 pt=96 ! udpsink host=" + dst_ip + " port=" + dst_port;
-    GstElement *pipeline_encode = gst_parse_launch(
-        pipeline_encode_str.c_str(),
-        NULL
-    );
+    // Also does the drop accounting when there is no deadline
+    frame_scheduler = std::make_unique<FrameScheduler>(frame_deadline);
 
-    std::cout << "Encode pipeline: " << pipeline_encode_str << std::endl;
+    std::unique_ptr<ControlServer> control_server;
+    if (!control_socket.empty()) {
+        try {
+            control_server = std::make_unique<ControlServer>(control_socket, *detector_slot, []() {
+                std::string stats = frame_scheduler->Summary();
+                if (encoder_queue) {
+                    stats += " " + encoder_queue->Summary();
+                }
+                return stats;
+            });
+            std::cout << "Control socket: " << control_socket << std::endl;
+        } catch (std::exception& e) {
+            std::cerr << "Can't start control server: " << e.what() << std::endl;
+            return -1;
+        }
+    }
 
-    GstElement *appsrc = gst_bin_get_by_name(GST_BIN(pipeline_encode), "source");
-    GstElement *appsink = gst_bin_get_by_name(GST_BIN(pipeline_capture), "mysink");
-    
-    g_object_set(appsink, "emit-signals", TRUE, "sync", FALSE, NULL);
-    g_signal_connect(appsink, "new-sample", G_CALLBACK(on_new_sample), appsrc);
+    FlightRecorder::Start(flight_dir, flight_frames, flight_threshold);
+    signal(SIGUSR1, on_sigusr1);
 
     std::cout << "Detection starting..." << std::endl;
+
     gst_element_set_state(pipeline_capture, GST_STATE_PLAYING);
     GstStateChangeReturn ret = gst_element_get_state(pipeline_capture, NULL, NULL, GST_CLOCK_TIME_NONE);
     if (ret == GST_STATE_CHANGE_FAILURE) {
@@ -196,8 +965,19 @@ int main(int argc, char* argv[]) {
         return -1;
     }
 
+    // Both pipelines run on one clock and base time, so capture PTS are valid running
+    // times in the encode pipeline as well
+    if (pipeline_encode) {
+        GstClock *clock = gst_pipeline_get_clock(GST_PIPELINE(pipeline_capture));
+        gst_pipeline_use_clock(GST_PIPELINE(pipeline_encode), clock);
+        gst_element_set_base_time(pipeline_encode, gst_element_get_base_time(pipeline_capture));
+        gst_element_set_start_time(pipeline_encode, GST_CLOCK_TIME_NONE);
+        gst_object_unref(clock);
+    }
+
+    // appsrc is live and doesn't preroll, retry only on a real failure
     auto start_time = std::chrono::steady_clock::now();
-    ret = GST_STATE_CHANGE_FAILURE;
+    ret = pipeline_encode ? GST_STATE_CHANGE_FAILURE : GST_STATE_CHANGE_SUCCESS;
     while(ret == GST_STATE_CHANGE_FAILURE) {
         if (std::chrono::steady_clock::now() - start_time > timeout) {
             std::cerr << "Failed to start detection" << std::endl;
@@ -205,19 +985,36 @@ int main(int argc, char* argv[]) {
         }
         gst_element_set_state(pipeline_encode, GST_STATE_PLAYING);
         ret = gst_element_get_state(pipeline_encode, NULL, NULL, GST_CLOCK_TIME_NONE);
-
-        std::this_thread::sleep_for(std::chrono::milliseconds(timeout.count() / 10));
+        if (ret == GST_STATE_CHANGE_FAILURE) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(timeout.count() / 10));
+        }
     }
 
     std::cout << "Detection started" << std::endl;
 
+    // Warm-up and pipeline start up stay out of the trace
+    if (!trace_path.empty()) {
+        Tracer::Start(trace_path, trace_seconds, trace_frames);
+    }
+    if (perf_counters) {
+        PerfCounters::Start(perf_report);
+    }
+    if (alloc_report || alloc_check) {
+        AllocTracker::Start(alloc_check, perf_report);
+    }
+
     GstBus *bus = gst_element_get_bus(pipeline_capture);
     GstMessage *msg;
     bool terminate = false;
 
     while (!terminate) {
-        msg = gst_bus_timed_pop_filtered(bus, GST_CLOCK_TIME_NONE, 
+        // Wakes up now and then for requested flight recorder dumps
+        msg = gst_bus_timed_pop_filtered(bus, 100 * GST_MSECOND,
                 static_cast<GstMessageType>(GST_MESSAGE_ERROR | GST_MESSAGE_EOS | GST_MESSAGE_STATE_CHANGED));
+        FlightRecorder::Poll();
+        if (AllocTracker::Finished()) {
+            terminate = true;
+        }
 
         if (msg != nullptr) {
             GError *err;
@@ -227,6 +1024,7 @@ int main(int argc, char* argv[]) {
                 case GST_MESSAGE_ERROR:
                     gst_message_parse_error(msg, &err, &debug_info);
                     std::cerr << "Error GStreamer: " << err->message << std::endl;
+                    FlightRecorder::Dump("bus_error");
                     g_clear_error(&err);
                     g_free(debug_info);
                     terminate = true;
@@ -252,9 +1050,24 @@ int main(int argc, char* argv[]) {
 
     gst_object_unref(bus);
     gst_element_set_state(pipeline_capture, GST_STATE_NULL);
-    gst_element_set_state(pipeline_encode, GST_STATE_NULL);
+    if (frame_pipeline) {
+        // Frames in flight still go to the encoder
+        frame_pipeline->Stop();
+    }
+    Tracer::Stop();
+    PerfCounters::Stop();
+    AllocTracker::Stop();
+    std::cout << "Frame scheduler: " << frame_scheduler->Summary() << std::endl;
     gst_object_unref(pipeline_capture);
-    gst_object_unref(pipeline_encode);
+    if (pipeline_encode) {
+        gst_element_set_state(pipeline_encode, GST_STATE_NULL);
+        gst_object_unref(pipeline_encode);
+    }
+    if (out_pool) {
+        gst_buffer_pool_set_active(out_pool, FALSE);
+        gst_object_unref(out_pool);
+    }
+    TaskExecutor::Stop();
 
-    return 0;
+    return alloc_check && !AllocTracker::Passed() ? 1 : 0;
 }
\ No newline at end of file
@@ -0,0 +1,249 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "backends/OnnxRuntimeBackend.hpp"
+#include "utils/ModelCache.hpp"
+#include "utils/Stage.hpp"
+
+#include <unistd.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <stdexcept>
+
+class OnnxRuntimeBackend::Context : public IInferenceBackend::Context {
+private:
+    OnnxRuntimeBackend& backend;
+    Ort::IoBinding binding{nullptr};
+    Ort::RunOptions runOptions;
+    std::vector<int64_t> inputShape;
+    std::vector<Ort::Value> outputValues;
+
+    LayerProfile* layerProfile;
+    int profiledRuns = 0;
+
+    void ProfileLayers(double forwardMs);
+
+public:
+    Context(OnnxRuntimeBackend& backend, LayerProfile* layerProfile);
+
+    void Forward(const cv::Mat& blob, std::vector<cv::Mat>& outs) override;
+};
+
+OnnxRuntimeBackend::Context::Context(OnnxRuntimeBackend& backend, LayerProfile* layerProfile)
+    : backend(backend)
+    , binding(backend.session)
+    , layerProfile(layerProfile)
+{
+    for (const auto& name : backend.outputNames) {
+        binding.BindOutput(name.c_str(), backend.memoryInfo);
+    }
+}
+
+static GraphOptimizationLevel ParseOptLevel(const std::string& level) {
+    if (level == "disable") {
+        return ORT_DISABLE_ALL;
+    } else if (level == "basic") {
+        return ORT_ENABLE_BASIC;
+    } else if (level == "extended") {
+        return ORT_ENABLE_EXTENDED;
+    } else if (level == "all") {
+        return ORT_ENABLE_ALL;
+    }
+    throw std::runtime_error("Unknown onnxruntime graph optimization level: " + level);
+}
+
+Ort::Env& OnnxRuntimeBackend::Env() {
+    static Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "odetect");
+    return env;
+}
+
+static Ort::SessionOptions MakeOptions(const BackendParams& params) {
+    Ort::SessionOptions options;
+    options.SetGraphOptimizationLevel(ParseOptLevel(params.ortOptLevel));
+    options.SetIntraOpNumThreads(params.ortIntraOpThreads);
+    options.SetInterOpNumThreads(params.ortInterOpThreads);
+    options.SetExecutionMode(params.ortInterOpThreads > 1 ? ORT_PARALLEL : ORT_SEQUENTIAL);
+    if (params.ortArena) {
+        options.EnableCpuMemArena();
+    } else {
+        options.DisableCpuMemArena();
+    }
+
+    // Weights of ORT format models are used from the mapping instead of being copied
+    options.AddConfigEntry("session.use_ort_model_bytes_directly", "1");
+    options.AddConfigEntry("session.use_ort_model_bytes_for_initializers", "1");
+
+    if (params.profileLayers > 0) {
+        options.EnableProfiling("/tmp/odetect-ort-profile");
+    }
+    return options;
+}
+
+OnnxRuntimeBackend::OnnxRuntimeBackend(const ModelSource& source, const BackendParams& params) {
+    if (source.format != ModelFormat::Onnx) {
+        throw std::runtime_error("onnxruntime backend can read ONNX models only");
+    }
+
+    modelFile = std::make_unique<MappedFile>(source.model);
+
+    ModelCache cache(params.cacheDir);
+    std::string entryPath;
+    bool loaded = false;
+
+    if (cache.Usable()) {
+        entryPath = cache.EntryPath(*modelFile, params, "ort" + std::to_string(ORT_API_VERSION) + "-" + params.ortOptLevel, ".ort");
+        if (access(entryPath.c_str(), R_OK) == 0) {
+            try {
+                auto cached = std::make_unique<MappedFile>(entryPath);
+                Ort::SessionOptions options = MakeOptions(params);
+                options.SetGraphOptimizationLevel(ORT_DISABLE_ALL);
+                options.AddConfigEntry("session.load_model_format", "ORT");
+                session = Ort::Session(Env(), cached->Data(), cached->Size(), options);
+                modelFile = std::move(cached);
+                loaded = true;
+            } catch (const std::exception& e) {
+                std::cerr << "Dropping model cache entry " << entryPath << ": " << e.what() << std::endl;
+                unlink(entryPath.c_str());
+            }
+        }
+    }
+
+    if (!loaded) {
+        Ort::SessionOptions options = MakeOptions(params);
+        std::string stagingPath;
+        if (cache.Usable()) {
+            stagingPath = cache.StagingPath(entryPath);
+            options.SetOptimizedModelFilePath(stagingPath.c_str());
+            options.AddConfigEntry("session.save_model_format", "ORT");
+        }
+
+        session = Ort::Session(Env(), modelFile->Data(), modelFile->Size(), options);
+
+        if (!stagingPath.empty() && cache.Publish(stagingPath, entryPath)) {
+            std::cout << "Optimized model cached in " << entryPath << std::endl;
+        }
+    }
+
+    memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    inputName = session.GetInputNameAllocated(0, allocator).get();
+    for (size_t i = 0; i < session.GetOutputCount(); i++) {
+        outputNames.push_back(session.GetOutputNameAllocated(i, allocator).get());
+    }
+
+    if (params.profileLayers > 0) {
+        layerProfile = std::make_unique<LayerProfile>(BackendTitle(source, params), params.profileLayers);
+    }
+}
+
+std::unique_ptr<IInferenceBackend> OnnxRuntimeBackend::Construct(const ModelSource& source, const BackendParams& params) {
+    return std::make_unique<OnnxRuntimeBackend>(source, params);
+}
+
+std::unique_ptr<IInferenceBackend::Context> OnnxRuntimeBackend::CreateContext() {
+    // The session profiler is of the whole session, its report goes through one context
+    std::lock_guard<std::mutex> lock(mutex);
+    LayerProfile* profile = profileTaken ? nullptr : layerProfile.get();
+    profileTaken = true;
+    return std::make_unique<Context>(*this, profile);
+}
+
+void OnnxRuntimeBackend::Context::Forward(const cv::Mat& blob, std::vector<cv::Mat>& outs) {
+    ODETECT_STAGE(Stage::Forward);
+    CV_Assert(blob.type() == CV_32F && blob.isContinuous());
+
+    // Zero copy input, the tensor only wraps the blob for the duration of Run
+    inputShape.assign(blob.size.p, blob.size.p + blob.dims);
+    Ort::Value input = Ort::Value::CreateTensor<float>(backend.memoryInfo, const_cast<float*>(blob.ptr<float>()), blob.total(),
+        inputShape.data(), inputShape.size());
+    binding.BindInput(backend.inputName.c_str(), input);
+
+    auto start = std::chrono::steady_clock::now();
+    backend.session.Run(runOptions, binding);
+    if (layerProfile && layerProfile->Collecting()) {
+        ProfileLayers(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    outputValues = binding.GetOutputValues();
+    outs.resize(outputValues.size());
+    for (size_t i = 0; i < outputValues.size(); i++) {
+        std::vector<int64_t> shape = outputValues[i].GetTensorTypeAndShapeInfo().GetShape();
+        std::vector<int> dims(shape.begin(), shape.end());
+        outs[i] = cv::Mat(dims, CV_32F, outputValues[i].GetTensorMutableData<float>());
+    }
+}
+
+// The session profiler only hands out its file at the end: node times over all runs in
+// it (warm-up and other contexts included) are averaged and count as the times of every profiled pass
+void OnnxRuntimeBackend::Context::ProfileLayers(double forwardMs) {
+    profiledRuns++;
+    if (!layerProfile->LastPass()) {
+        layerProfile->PassDone(forwardMs);
+        return;
+    }
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    std::string path = backend.session.EndProfilingAllocated(allocator).get();
+    std::ifstream file(path);
+
+    // One event per line: {"cat" : "Node", ..., "dur" :12, ..., "name" :"Conv_0_kernel_time", "args" : {..."op_name" : "Conv"...}}
+    const std::regex nodeRe("\"cat\"\\s*:\\s*\"Node\"");
+    const std::regex runRe("\"name\"\\s*:\\s*\"model_run\"");
+    const std::regex durRe("\"dur\"\\s*:\\s*(\\d+)");
+    const std::regex nameRe("\"name\"\\s*:\\s*\"([^\"]*)_kernel_time\"");
+    const std::regex opRe("\"op_name\"\\s*:\\s*\"([^\"]*)\"");
+
+    std::map<std::string, std::pair<std::string, double>> nodes;
+    std::vector<std::string> order;
+    int runs = 0;
+    std::string line;
+    std::smatch dur, name, op;
+    while (std::getline(file, line)) {
+        if (std::regex_search(line, runRe)) {
+            runs++;
+        } else if (std::regex_search(line, nodeRe) && std::regex_search(line, name, nameRe) && std::regex_search(line, dur, durRe)) {
+            auto& node = nodes[name[1].str()];
+            if (node.first.empty()) {
+                order.push_back(name[1].str());
+                node.first = std::regex_search(line, op, opRe) ? op[1].str() : std::string("?");
+            }
+            node.second += std::stod(dur[1]) / 1000.0;
+        }
+    }
+
+    if (nodes.empty()) {
+        std::cerr << "No node events in the onnxruntime profile " << path << std::endl;
+    }
+    runs = runs > 0 ? runs : profiledRuns;
+    for (const auto& nodeName : order) {
+        const auto& node = nodes[nodeName];
+        layerProfile->Add(nodeName, node.first, node.second * layerProfile->Passes() / runs);
+    }
+    layerProfile->PassDone(forwardMs);
+    std::cout << "onnxruntime profile (chrome://tracing): " << path << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,143 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "backends/OpenCvDnnBackend.hpp"
+#include "utils/MappedFile.hpp"
+#include "utils/Stage.hpp"
+
+#include <iostream>
+#include <stdexcept>
+
+class OpenCvDnnBackend::Context : public IInferenceBackend::Context {
+private:
+    cv::dnn::Net net;
+    std::vector<std::string> outNames;
+    LayerProfile* layerProfile;
+    std::vector<std::string> layerNames;
+    std::vector<std::string> layerTypes;
+
+    void ProfileLayers();
+
+public:
+    Context(cv::dnn::Net net, LayerProfile* layerProfile);
+
+    void Forward(const cv::Mat& blob, std::vector<cv::Mat>& outs) override;
+};
+
+OpenCvDnnBackend::Context::Context(cv::dnn::Net net, LayerProfile* layerProfile)
+    : net(net)
+    , layerProfile(layerProfile)
+{
+    outNames = net.getUnconnectedOutLayersNames();
+
+    if (layerProfile) {
+        layerNames = net.getLayerNames();
+        for (const auto& name : layerNames) {
+            layerTypes.push_back(net.getLayer(net.getLayerId(name))->type);
+        }
+    }
+}
+
+void OpenCvDnnBackend::Context::Forward(const cv::Mat& blob, std::vector<cv::Mat>& outs) {
+    ODETECT_STAGE(Stage::Forward);
+    net.setInput(blob);
+    net.forward(outs, outNames);
+
+    if (layerProfile && layerProfile->Collecting()) {
+        ProfileLayers();
+    }
+}
+
+// Times of the last forward pass, one per layer after the input. Layers fused into
+// their predecessor report 0
+void OpenCvDnnBackend::Context::ProfileLayers() {
+    std::vector<double> timings;
+    const double msPerTick = 1000.0 / cv::getTickFrequency();
+    double totalMs = net.getPerfProfile(timings) * msPerTick;
+    for (size_t i = 0; i < timings.size() && i < layerNames.size(); i++) {
+        layerProfile->Add(layerNames[i], layerTypes[i], timings[i] * msPerTick);
+    }
+    layerProfile->PassDone(totalMs);
+}
+
+OpenCvDnnBackend::OpenCvDnnBackend(const ModelSource& source, const BackendParams& params)
+    : source(source)
+    , params(params)
+{
+    if (params.profileLayers > 0) {
+        layerProfile = std::make_unique<LayerProfile>(BackendTitle(source, params), params.profileLayers);
+    }
+    // Only the first context is profiled, the report is of one pass at a time
+    loaded = std::make_unique<Context>(ReadNet(), layerProfile.get());
+}
+
+OpenCvDnnBackend::~OpenCvDnnBackend() = default;
+
+std::unique_ptr<IInferenceBackend> OpenCvDnnBackend::Construct(const ModelSource& source, const BackendParams& params) {
+    return std::make_unique<OpenCvDnnBackend>(source, params);
+}
+
+cv::dnn::Net OpenCvDnnBackend::ReadNet() const {
+    // The files are parsed straight from the page cache instead of being read into a
+    // private copy first. That is all: cv::dnn::Net keeps the weights on its own heap,
+    // so every process (and every context) still holds a private copy of them.
+    cv::dnn::Net net;
+    switch (source.format) {
+        case ModelFormat::Caffe: {
+            MappedFile config(source.config);
+            MappedFile model(source.model);
+            net = cv::dnn::readNetFromCaffe(config.Data(), config.Size(), model.Data(), model.Size());
+            break;
+        }
+        case ModelFormat::Onnx: {
+            MappedFile model(source.model);
+            net = cv::dnn::readNetFromONNX(model.Data(), model.Size());
+            break;
+        }
+        default:
+            throw std::runtime_error("opencv backend can't read the model format of " + source.model);
+    }
+
+    net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+    if (params.precision == Precision::FP16) {
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 9)
+        net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU_FP16);
+#else
+        std::cerr << "OpenCV " CV_VERSION " has no fp16 CPU target, running fp16 weights in fp32" << std::endl;
+        net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+#endif
+    } else {
+        // int8 comes from the quantized model itself
+        net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+    }
+    return net;
+}
+
+std::unique_ptr<IInferenceBackend::Context> OpenCvDnnBackend::CreateContext() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (loaded) {
+        return std::move(loaded);
+    }
+    return std::make_unique<Context>(ReadNet(), nullptr);
+}
\ No newline at end of file
@@ -0,0 +1,277 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "backends/TfLiteBackend.hpp"
+#include "utils/ModelCache.hpp"
+#include "utils/Stage.hpp"
+
+#include <tensorflow/lite/kernels/register.h>
+#include <tensorflow/lite/delegates/xnnpack/xnnpack_delegate.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <thread>
+
+template <typename T, typename Convert>
+static void PackInput(const float* src, T* dst, int channels, int plane, bool nhwc, Convert convert) {
+    for (int c = 0; c < channels; c++) {
+        const float* srcPlane = src + c * plane;
+        if (nhwc) {
+            for (int i = 0; i < plane; i++) {
+                dst[i * channels + c] = convert(srcPlane[i]);
+            }
+        } else {
+            T* dstPlane = dst + c * plane;
+            for (int i = 0; i < plane; i++) {
+                dstPlane[i] = convert(srcPlane[i]);
+            }
+        }
+    }
+}
+
+class TfLiteBackend::Context : public IInferenceBackend::Context {
+private:
+    LayerProfile* layerProfile;
+
+    // Destruction order matters: the interpreter first, it uses the delegate and the
+    // profiler up to the end
+    std::unique_ptr<tflite::profiling::BufferedProfiler> profiler;
+    std::unique_ptr<TfLiteDelegate, void(*)(TfLiteDelegate*)> delegate;
+    std::unique_ptr<tflite::Interpreter> interpreter;
+
+    std::vector<std::vector<float>> dequantized;
+
+    void FillInput(const cv::Mat& blob);
+    void ProfileLayers(double forwardMs);
+
+public:
+    Context(const TfLiteBackend& backend, LayerProfile* layerProfile);
+
+    void Forward(const cv::Mat& blob, std::vector<cv::Mat>& outs) override;
+};
+
+TfLiteBackend::Context::Context(const TfLiteBackend& backend, LayerProfile* layerProfile)
+    : layerProfile(layerProfile)
+    , delegate(nullptr, TfLiteXNNPackDelegateDelete)
+{
+    const BackendParams& params = backend.params;
+
+    // XNNPACK is applied explicitly below to control its options
+    tflite::ops::builtin::BuiltinOpResolverWithoutDefaultDelegates resolver;
+    if (tflite::InterpreterBuilder(*backend.model, resolver)(&interpreter) != kTfLiteOk || !interpreter) {
+        throw std::runtime_error("Can't build tflite interpreter for " + backend.modelPath);
+    }
+
+    int threads = params.tfliteThreads > 0 ? params.tfliteThreads : static_cast<int>(std::thread::hardware_concurrency());
+    interpreter->SetNumThreads(threads);
+
+    TfLiteXNNPackDelegateOptions options = TfLiteXNNPackDelegateOptionsDefault();
+    options.num_threads = threads;
+    options.flags |= TFLITE_XNNPACK_DELEGATE_FLAG_QS8 | TFLITE_XNNPACK_DELEGATE_FLAG_QU8;
+    if (params.precision == Precision::FP16) {
+        // Half precision arithmetic, not only fp16 storage (ARMv8.2 FP16 cores, e.g. Cortex-A76)
+        options.flags |= TFLITE_XNNPACK_DELEGATE_FLAG_FORCE_FP16;
+    }
+
+#ifdef ODETECT_XNNPACK_WEIGHT_CACHE
+    if (!backend.weightCachePath.empty()) {
+        options.weight_cache_file_path = backend.weightCachePath.c_str();
+    }
+#endif
+
+    // XNNPACK reports its own operators to the profiler as delegate operator events, but
+    // only if the profiler is there when its kernels are prepared
+    if (layerProfile) {
+        profiler = std::make_unique<tflite::profiling::BufferedProfiler>(4096);
+        interpreter->SetProfiler(profiler.get());
+    }
+    delegate.reset(TfLiteXNNPackDelegateCreate(&options));
+    if (interpreter->ModifyGraphWithDelegate(delegate.get()) != kTfLiteOk) {
+        throw std::runtime_error("Can't apply XNNPACK delegate to " + backend.modelPath);
+    }
+
+    if (interpreter->AllocateTensors() != kTfLiteOk) {
+        throw std::runtime_error("Can't allocate tflite tensors for " + backend.modelPath);
+    }
+}
+
+TfLiteBackend::TfLiteBackend(const ModelSource& source, const BackendParams& params)
+    : params(params)
+    , modelPath(source.model)
+{
+    if (source.format != ModelFormat::TfLite) {
+        throw std::runtime_error("tflite backend can read .tflite models only");
+    }
+
+    // BuildFromFile maps the flatbuffer read-only and runs on it in place
+    model = tflite::FlatBufferModel::BuildFromFile(source.model.c_str());
+    if (!model) {
+        throw std::runtime_error("Can't load tflite model " + source.model);
+    }
+
+#ifdef ODETECT_XNNPACK_WEIGHT_CACHE
+    // XNNPACK validates and fills the file itself, repacking is skipped on a hit
+    ModelCache cache(params.cacheDir);
+    if (cache.Usable()) {
+        MappedFile modelFile(source.model);
+        weightCachePath = cache.EntryPath(modelFile, params, "xnnpack", ".xnnpack");
+    }
+#endif
+
+    if (params.profileLayers > 0) {
+        layerProfile = std::make_unique<LayerProfile>(BackendTitle(source, params), params.profileLayers);
+    }
+    // Only the first context is profiled, the report is of one pass at a time
+    loaded = std::make_unique<Context>(*this, layerProfile.get());
+}
+
+TfLiteBackend::~TfLiteBackend() = default;
+
+std::unique_ptr<IInferenceBackend> TfLiteBackend::Construct(const ModelSource& source, const BackendParams& params) {
+    return std::make_unique<TfLiteBackend>(source, params);
+}
+
+std::unique_ptr<IInferenceBackend::Context> TfLiteBackend::CreateContext() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (loaded) {
+        return std::move(loaded);
+    }
+    return std::make_unique<Context>(*this, nullptr);
+}
+
+void TfLiteBackend::Context::FillInput(const cv::Mat& blob) {
+    CV_Assert(blob.dims == 4 && blob.type() == CV_32F && blob.isContinuous());
+    const int channels = blob.size[1];
+    const int height = blob.size[2];
+    const int width = blob.size[3];
+
+    int index = interpreter->inputs()[0];
+    TfLiteTensor* tensor = interpreter->tensor(index);
+
+    // Converted models are usually NHWC
+    bool nhwc = tensor->dims->size == 4 && tensor->dims->data[3] == channels && tensor->dims->data[1] != channels;
+    std::vector<int> dims = nhwc ? std::vector<int>{1, height, width, channels} : std::vector<int>{1, channels, height, width};
+    if (!std::equal(dims.begin(), dims.end(), tensor->dims->data, tensor->dims->data + tensor->dims->size)) {
+        if (interpreter->ResizeInputTensor(index, dims) != kTfLiteOk || interpreter->AllocateTensors() != kTfLiteOk) {
+            throw std::runtime_error("Can't resize tflite input tensor");
+        }
+        tensor = interpreter->tensor(index);
+    }
+
+    const float* src = blob.ptr<float>();
+    const int plane = height * width;
+    const float scale = tensor->params.scale;
+    const int zeroPoint = tensor->params.zero_point;
+
+    switch (tensor->type) {
+        case kTfLiteFloat32:
+            PackInput(src, tensor->data.f, channels, plane, nhwc, [](float x) { return x; });
+            break;
+        case kTfLiteInt8:
+            PackInput(src, tensor->data.int8, channels, plane, nhwc, [=](float x) {
+                return static_cast<int8_t>(std::clamp<long>(std::lround(x / scale) + zeroPoint, -128, 127));
+            });
+            break;
+        case kTfLiteUInt8:
+            PackInput(src, tensor->data.uint8, channels, plane, nhwc, [=](float x) {
+                return static_cast<uint8_t>(std::clamp<long>(std::lround(x / scale) + zeroPoint, 0, 255));
+            });
+            break;
+        default:
+            throw std::runtime_error("Unsupported tflite input tensor type");
+    }
+}
+
+void TfLiteBackend::Context::Forward(const cv::Mat& blob, std::vector<cv::Mat>& outs) {
+    ODETECT_STAGE(Stage::Forward);
+    FillInput(blob);
+
+    bool profile = layerProfile && layerProfile->Collecting();
+    if (profile) {
+        profiler->Reset();
+        profiler->StartProfiling();
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (interpreter->Invoke() != kTfLiteOk) {
+        throw std::runtime_error("tflite inference failed");
+    }
+    if (profile) {
+        profiler->StopProfiling();
+        ProfileLayers(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    const auto& outputs = interpreter->outputs();
+    outs.resize(outputs.size());
+    dequantized.resize(outputs.size());
+    for (size_t i = 0; i < outputs.size(); i++) {
+        TfLiteTensor* tensor = interpreter->tensor(outputs[i]);
+        std::vector<int> dims(tensor->dims->data, tensor->dims->data + tensor->dims->size);
+        const float scale = tensor->params.scale;
+        const int zeroPoint = tensor->params.zero_point;
+
+        switch (tensor->type) {
+            case kTfLiteFloat32:
+                outs[i] = cv::Mat(dims, CV_32F, tensor->data.f);
+                break;
+            case kTfLiteInt8:
+                dequantized[i].resize(tensor->bytes);
+                for (size_t k = 0; k < tensor->bytes; k++) {
+                    dequantized[i][k] = (tensor->data.int8[k] - zeroPoint) * scale;
+                }
+                outs[i] = cv::Mat(dims, CV_32F, dequantized[i].data());
+                break;
+            case kTfLiteUInt8:
+                dequantized[i].resize(tensor->bytes);
+                for (size_t k = 0; k < tensor->bytes; k++) {
+                    dequantized[i][k] = (tensor->data.uint8[k] - zeroPoint) * scale;
+                }
+                outs[i] = cv::Mat(dims, CV_32F, dequantized[i].data());
+                break;
+            default:
+                throw std::runtime_error("Unsupported tflite output tensor type");
+        }
+    }
+}
+
+// The delegate kernel node covers the operators it runs, it is left out when they are reported
+void TfLiteBackend::Context::ProfileLayers(double forwardMs) {
+    using tflite::profiling::ProfileEvent;
+    auto events = profiler->GetProfileEvents();
+    bool delegateOps = std::any_of(events.begin(), events.end(), [](const ProfileEvent* event) {
+        return event->event_type == ProfileEvent::EventType::DELEGATE_OPERATOR_INVOKE_EVENT;
+    });
+
+    for (const ProfileEvent* event : events) {
+        bool op = event->event_type == ProfileEvent::EventType::OPERATOR_INVOKE_EVENT;
+        bool delegateOp = event->event_type == ProfileEvent::EventType::DELEGATE_OPERATOR_INVOKE_EVENT;
+        if ((!op && !delegateOp) || (op && delegateOps && std::string(event->tag).find("Delegate") != std::string::npos)) {
+            continue;
+        }
+        std::string type = event->tag;
+        layerProfile->Add(type + ":" + std::to_string(event->event_metadata), type, event->elapsed_time / 1000.0);
+    }
+    layerProfile->PassDone(forwardMs);
+}
\ No newline at end of file
@@ -55,15 +55,16 @@ const char* PixelFormatToString(OdPixelFmt fourcc) {
     return fourcc_str;    
 }
 
-uint8_t GetOdCapsFromVideoDev(const char* video_dev_path, ODCaps* caps) {
-    int fd = open(video_dev_path, O_RDWR);
-    if (fd == -1) {
-        perror("Failed to open video device");
+// First frame size of the first capture format matching fourcc, 0 - any raw format
+static uint8_t GetOdCapsByFormat(const char* video_dev_path, OdPixelFmt fourcc, ODCaps* caps) {
+    if (!caps) {
+        fprintf(stderr, "Invalid ptr for caps\n");
         return 1;
     }
 
-    if (!caps) {
-        perror("Invalid ptr for caps");
+    int fd = open(video_dev_path, O_RDWR);
+    if (fd == -1) {
+        perror("Failed to open video device");
         return 1;
     }
 
@@ -75,7 +76,8 @@ uint8_t GetOdCapsFromVideoDev(const char* video_dev_path, ODCaps* caps) {
     int found = 0;
 
     while (ioctl(fd, VIDIOC_ENUM_FMT, &fmt_desc) == 0) {
-        if (!(fmt_desc.flags & V4L2_FMT_FLAG_COMPRESSED)) {
+        int compressed = (fmt_desc.flags & V4L2_FMT_FLAG_COMPRESSED) != 0;
+        if (fourcc ? fmt_desc.pixelformat == fourcc : !compressed) {
 
             struct v4l2_frmsizeenum frmsize;
             memset(&frmsize, 0, sizeof(frmsize));
@@ -86,9 +88,11 @@ uint8_t GetOdCapsFromVideoDev(const char* video_dev_path, ODCaps* caps) {
                 caps->width = frmsize.discrete.width;
                 caps->height = frmsize.discrete.height;
                 caps->pformat = fmt_desc.pixelformat;
-                caps->channels = GetChannelsByPixelFormat(caps->pformat);
+                // compressed, no raw planes
+                caps->channels = compressed ? 0 : GetChannelsByPixelFormat(caps->pformat);
                 found = 1;
-                printf("Found RAW format: %s, %ux%u\n", PixelFormatToString(fmt_desc.pixelformat), caps->width, caps->height);
+                printf("Found %s format: %s, %ux%u\n", compressed ? "compressed" : "RAW",
+                       PixelFormatToString(fmt_desc.pixelformat), caps->width, caps->height);
                 break;
             } else {
                 perror("Failed to get frame sizes");
@@ -99,13 +103,20 @@ uint8_t GetOdCapsFromVideoDev(const char* video_dev_path, ODCaps* caps) {
         fmt_desc.index++;
     }
 
+    close(fd);
+
     if (!found) {
-        fprintf(stderr, "No suitable RAW format found\n");
-        close(fd);
+        fprintf(stderr, "No %s format found\n", fourcc ? PixelFormatToString(fourcc) : "suitable RAW");
         return 1;
     }
 
-    close(fd);
-
     return 0;
+}
+
+uint8_t GetOdCapsFromVideoDev(const char* video_dev_path, ODCaps* caps) {
+    return GetOdCapsByFormat(video_dev_path, 0, caps);
+}
+
+uint8_t GetOdH264CapsFromVideoDev(const char* video_dev_path, ODCaps* caps) {
+    return GetOdCapsByFormat(video_dev_path, V4L2_PIX_FMT_H264, caps);
 }
\ No newline at end of file
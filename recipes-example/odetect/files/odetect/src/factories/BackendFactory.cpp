@@ -0,0 +1,83 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "factories/BackendFactory.hpp"
+#include "backends/OpenCvDnnBackend.hpp"
+#ifdef ODETECT_WITH_ONNXRUNTIME
+#include "backends/OnnxRuntimeBackend.hpp"
+#endif
+#ifdef ODETECT_WITH_TFLITE
+#include "backends/TfLiteBackend.hpp"
+#endif
+
+#include <algorithm>
+#include <stdexcept>
+#include <unistd.h>
+
+std::map<std::string, BackendFactory::Unit> BackendFactory::factory = {
+    {"opencv", {{ModelFormat::Caffe, ModelFormat::Onnx}, {Precision::FP32, Precision::FP16, Precision::INT8}, &OpenCvDnnBackend::Construct}},
+#ifdef ODETECT_WITH_ONNXRUNTIME
+    {"onnxruntime", {{ModelFormat::Onnx}, {Precision::FP32, Precision::INT8}, &OnnxRuntimeBackend::Construct}},
+#endif
+#ifdef ODETECT_WITH_TFLITE
+    {"tflite", {{ModelFormat::TfLite}, {Precision::FP32, Precision::FP16, Precision::INT8}, &TfLiteBackend::Construct}},
+#endif
+};
+
+std::unique_ptr<IInferenceBackend> BackendFactory::Create(const std::vector<ModelSource>& sources, const BackendParams& params) {
+    auto unit = factory.find(params.name);
+    if (unit == factory.end()) {
+        throw std::runtime_error("Unknown inference backend: " + params.name);
+    }
+
+    const auto& precisions = unit->second.precisions;
+    if (std::find(precisions.begin(), precisions.end(), params.precision) == precisions.end()) {
+        throw std::runtime_error("Backend " + params.name + " doesn't support " + PrecisionToString(params.precision) + " inference");
+    }
+
+    // A model may ship several variants of one format and precision,
+    // the first one present on disk wins
+    const ModelSource* readable = nullptr;
+    for (const auto& source : sources) {
+        const auto& formats = unit->second.formats;
+        if (source.precision != params.precision) {
+            continue;
+        }
+        if (std::find(formats.begin(), formats.end(), source.format) != formats.end()) {
+            if (access(source.model.c_str(), R_OK) == 0) {
+                return unit->second.construct(source, params);
+            }
+            if (!readable) {
+                readable = &source;
+            }
+        }
+    }
+
+    if (readable) {
+        // Let the backend report the missing file
+        return unit->second.construct(*readable, params);
+    }
+
+    throw std::runtime_error("Backend " + params.name + " can't read any " + PrecisionToString(params.precision) + " variant of the model");
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "interfaces/backends/IInferenceBackend.hpp"
+
+#include <cstring>
+#include <stdexcept>
+
+Precision ParsePrecision(const std::string& name) {
+    if (name == "fp32") {
+        return Precision::FP32;
+    } else if (name == "fp16") {
+        return Precision::FP16;
+    } else if (name == "int8") {
+        return Precision::INT8;
+    }
+    throw std::runtime_error("Unknown precision: " + name);
+}
+
+const char* PrecisionToString(Precision precision) {
+    switch (precision) {
+        case Precision::FP32:
+            return "fp32";
+        case Precision::FP16:
+            return "fp16";
+        case Precision::INT8:
+            return "int8";
+    }
+    return "unknown";
+}
+
+std::string BackendTitle(const ModelSource& source, const BackendParams& params) {
+    std::string file = source.model.substr(source.model.find_last_of('/') + 1);
+    return file + " " + std::to_string(params.inputSize.width) + "x" + std::to_string(params.inputSize.height)
+        + " " + params.name + " " + PrecisionToString(params.precision);
+}
+
+void CopyOutput(const cv::Mat& src, cv::Mat& dst) {
+    // Backends hand out whole blobs
+    CV_Assert(src.isContinuous());
+    dst.create(src.dims, src.size.p, src.type());
+    memcpy(dst.data, src.data, src.total() * src.elemSize());
+}
\ No newline at end of file
@@ -23,12 +23,26 @@ THE SOFTWARE.
 */
 
 #include "interfaces/models/IModelDnnDetector.hpp"
+#include "utils/TileGrid.hpp"
+#include "utils/MotionGate.hpp"
+#include "utils/Stage.hpp"
+#include "utils/TaskExecutor.hpp"
 
 #include <stdexcept>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
 #include <linux/videodev2.h>
 
 IModelDnnDetector::IModelDnnDetector(const ODCaps& inCaps)
-    : inCaps(inCaps)
+    : tileOverlap(-1), refineThreshold(0), refineMax(0)
+    , frames([this]() {
+        auto frame = std::make_unique<Frame>();
+        frame->buffer.resize(this->inCaps.width * this->inCaps.height * this->inCaps.channels);
+        return frame;
+    }, 0)
+    , inCaps(inCaps), contexts(1)
+    , scratch([]() { return std::make_unique<Scratch>(); }, 0)
 {
     if (inCaps.pformat == V4L2_PIX_FMT_BGR24) {
         colorConvertId = COLOR_CVT_NONE;
@@ -39,6 +53,93 @@ IModelDnnDetector::IModelDnnDetector(const ODCaps& inCaps)
     }
 }
 
+IModelDnnDetector::~IModelDnnDetector() = default;
+
+void IModelDnnDetector::Scratch::Clear() {
+    found.clear();
+    results.clear();
+    candidates.clear();
+    windows.clear();
+    views.clear();
+    for (auto& frameDetections : batch) {
+        frameDetections.clear();
+    }
+    boxes.clear();
+    scores.clear();
+    indices.clear();
+}
+
+void IModelDnnDetector::SetThreshold(float threshold) {
+    if (threshold <= 0 || threshold > 1) {
+        throw std::runtime_error("Threshold must be in (0..1]");
+    }
+    modelThreshold.store(threshold, std::memory_order_relaxed);
+}
+
+float IModelDnnDetector::GetThreshold() const {
+    return modelThreshold.load(std::memory_order_relaxed);
+}
+
+void IModelDnnDetector::SetRoi(std::shared_ptr<const RoiMask> roi) {
+    this->roi = std::move(roi);
+    BuildTiles();
+}
+
+void IModelDnnDetector::SetTiling(int tileSize, float overlap) {
+    if (tileSize < 0 || overlap < 0 || overlap >= 1) {
+        throw std::runtime_error("Tile size must be >= 0 and overlap in [0..1)");
+    }
+    this->tileSize = tileSize ? cv::Size(tileSize, tileSize) : inputSize;
+    tileOverlap = overlap;
+    BuildTiles();
+}
+
+void IModelDnnDetector::SetRefinement(float candidateThreshold, int maxCandidates) {
+    if (candidateThreshold <= 0 || candidateThreshold > 1 || maxCandidates < 0) {
+        throw std::runtime_error("Refinement threshold must be in (0..1] and candidates >= 0");
+    }
+    refineThreshold = candidateThreshold;
+    refineMax = maxCandidates;
+}
+
+void IModelDnnDetector::SetMotionGate(float sensitivity, int maxSkip) {
+    motionGate = std::make_unique<MotionGate>(inCaps, sensitivity, maxSkip);
+}
+
+bool IModelDnnDetector::CheckMotion(const OdBuf inBuf) const {
+    if (!motionGate) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(motionMutex);
+    return motionGate->Check(inBuf, !lastDetections.empty());
+}
+
+void IModelDnnDetector::RememberDetections(const std::vector<ODDetection>& detections) const {
+    if (motionGate) {
+        std::lock_guard<std::mutex> lock(motionMutex);
+        lastDetections = detections;
+    }
+}
+
+void IModelDnnDetector::RecallDetections(std::vector<ODDetection>& detections) const {
+    std::lock_guard<std::mutex> lock(motionMutex);
+    detections = lastDetections;
+}
+
+void IModelDnnDetector::BuildTiles() {
+    tileGrid.reset();
+    if (tileOverlap < 0) {
+        return;
+    }
+
+    cv::Size area = roi ? roi->Bounds().size() : cv::Size(inCaps.width, inCaps.height);
+    auto grid = std::make_unique<TileGrid>(area, tileSize, tileOverlap);
+    // Nothing to gain when the area fits a single tile
+    if (grid->Tiles().size() > 1) {
+        tileGrid = std::move(grid);
+    }
+}
+
 void IModelDnnDetector::InputPreProcess(const OdBuf inBuf, cv::Mat& outFrame) const {
     cv::Mat inFrame(inCaps.height, inCaps.width, CV_MAKETYPE(CV_8U, inCaps.channels), inBuf);
     if (colorConvertId == COLOR_CVT_NONE) {
@@ -47,3 +148,319 @@ void IModelDnnDetector::InputPreProcess(const OdBuf inBuf, cv::Mat& outFrame) co
         cv::cvtColor(inFrame, outFrame, colorConvertId);
     }
 }
+
+void IModelDnnDetector::DrawDetections(cv::Mat& frame, const std::vector<ODDetection>& detections) const {
+    if (roi) {
+        cv::polylines(frame, roi->Zones(), true, cv::Scalar(0, 255, 255), 1);
+    }
+    for (const auto& det : detections) {
+        cv::rectangle(frame, det.box.tl(), det.box.br(), cv::Scalar(0, 255, 0), 3, 8);
+        for (const auto& point : det.landmarks) {
+            cv::circle(frame, point, 5, cv::Scalar(0, 0, 255), -1);
+        }
+    }
+}
+
+void IModelDnnDetector::Infer(const cv::Mat& bgrFrame, std::vector<ODDetection>& detections) const {
+    Infer(bgrFrame, GetThreshold(), detections);
+}
+
+// On the shared executor where there is one: OpenCV runs a parallel_for_ nested in
+// another one serially, the executor lets the passes' own loops spread as well. The
+// passes count for the caller's frame, whichever thread runs them
+template <typename Fn>
+void IModelDnnDetector::ParallelRun(int count, const Fn& fn) const {
+    FrameContext frame;
+    auto run = [&](int begin, int end) {
+        FrameContext::Join join(frame);
+        fn(begin, end);
+    };
+    if (TaskExecutor* executor = TaskExecutor::Shared()) {
+        executor->ParallelFor(count, contexts, run);
+        return;
+    }
+    cv::parallel_for_(cv::Range(0, count), [&](const cv::Range& range) {
+        run(range.start, range.end);
+    }, contexts);
+}
+
+void IModelDnnDetector::InferBatch(const std::vector<cv::Mat>& bgrFrames, float threshold, std::vector<std::vector<ODDetection>>& detections) const {
+    // Cleared rather than reassigned, the lists keep their capacity
+    detections.resize(bgrFrames.size());
+    for (auto& frameDetections : detections) {
+        frameDetections.clear();
+    }
+    if (contexts == 1 || bgrFrames.size() == 1) {
+        for (size_t i = 0; i < bgrFrames.size(); i++) {
+            Infer(bgrFrames[i], threshold, detections[i]);
+        }
+        return;
+    }
+
+    ParallelRun(static_cast<int>(bgrFrames.size()), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            Infer(bgrFrames[i], threshold, detections[i]);
+        }
+    });
+}
+
+void IModelDnnDetector::InferTiles(const cv::Mat& region, std::vector<ODDetection>& detections) const {
+    const auto& tiles = tileGrid->Tiles();
+    auto lists = scratch.Acquire();
+    lists->Clear();
+    std::vector<cv::Mat>& views = lists->views;
+    for (const auto& tile : tiles) {
+        views.push_back(region(tile));
+    }
+    // Objects bigger than a tile are only whole on the downscaled region
+    views.push_back(region);
+
+    std::vector<std::vector<ODDetection>>& found = lists->batch;
+    InferBatch(views, GetThreshold(), found);
+    views.clear();
+
+    for (size_t i = 0; i < tiles.size(); i++) {
+        const cv::Point offset = tiles[i].tl();
+        for (auto& det : found[i]) {
+            det.box += offset;
+            for (auto& point : det.landmarks) {
+                point += offset;
+            }
+        }
+    }
+    ODETECT_STAGE(Stage::Nms);
+    tileGrid->Merge(found, detections);
+}
+
+void IModelDnnDetector::InferRefined(const cv::Mat& region, std::vector<ODDetection>& detections) const {
+    const float threshold = GetThreshold();
+    auto lists = scratch.Acquire();
+    lists->Clear();
+    std::vector<ODDetection>& coarse = lists->found;
+    Infer(region, std::min(refineThreshold, threshold), coarse);
+
+    // Confident boxes big enough for the coarse scale are final, the rest are candidates
+    const double scale = std::min(static_cast<double>(inputSize.width) / region.cols,
+                                  static_cast<double>(inputSize.height) / region.rows);
+    std::vector<ODDetection>& results = lists->results;
+    std::vector<ODDetection>& candidates = lists->candidates;
+    for (auto& det : coarse) {
+        bool small = std::min(det.box.width, det.box.height) * scale < refineMinInput;
+        if (det.confidence >= threshold && !small) {
+            results.push_back(std::move(det));
+        } else {
+            candidates.push_back(std::move(det));
+        }
+    }
+    if (candidates.empty()) {
+        detections.insert(detections.end(), results.begin(), results.end());
+        return;
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const ODDetection& a, const ODDetection& b) {
+        return a.confidence > b.confidence;
+    });
+
+    // Windows around the candidates, at least the network input at full resolution
+    const cv::Rect area(0, 0, region.cols, region.rows);
+    std::vector<cv::Rect>& windows = lists->windows;
+    std::vector<cv::Mat>& views = lists->views;
+    for (size_t i = 0; i < candidates.size() && windows.size() < static_cast<size_t>(refineMax); i++) {
+        const cv::Rect& box = candidates[i].box;
+        cv::Size size(std::max(inputSize.width, box.width * 3), std::max(inputSize.height, box.height * 3));
+        cv::Rect window(box.x + box.width / 2 - size.width / 2, box.y + box.height / 2 - size.height / 2, size.width, size.height);
+        window.x = std::max(0, std::min(window.x, region.cols - window.width));
+        window.y = std::max(0, std::min(window.y, region.rows - window.height));
+        window &= area;
+        windows.push_back(window);
+        views.push_back(region(window));
+    }
+
+    std::vector<std::vector<ODDetection>>& refined = lists->batch;
+    InferBatch(views, threshold, refined);
+    views.clear();
+
+    for (size_t i = 0; i < windows.size(); i++) {
+        const cv::Point offset = windows[i].tl();
+        for (auto& det : refined[i]) {
+            det.box += offset;
+            for (auto& point : det.landmarks) {
+                point += offset;
+            }
+            results.push_back(std::move(det));
+        }
+    }
+    // Confident small boxes stay, a refined duplicate wins the NMS if it scores higher
+    for (auto& det : candidates) {
+        if (det.confidence >= threshold) {
+            results.push_back(std::move(det));
+        }
+    }
+
+    std::vector<cv::Rect>& boxes = lists->boxes;
+    std::vector<float>& scores = lists->scores;
+    for (const auto& det : results) {
+        boxes.push_back(det.box);
+        scores.push_back(det.confidence);
+    }
+    ODETECT_STAGE(Stage::Nms);
+    std::vector<int>& indices = lists->indices;
+    cv::dnn::NMSBoxes(boxes, scores, 0, refineNmsThreshold, indices);
+    for (int idx : indices) {
+        detections.push_back(std::move(results[idx]));
+    }
+}
+
+void IModelDnnDetector::InferArea(const cv::Mat& area, std::vector<ODDetection>& detections) const {
+    if (tileGrid) {
+        InferTiles(area, detections);
+    } else if (refineMax > 0) {
+        InferRefined(area, detections);
+    } else {
+        Infer(area, detections);
+    }
+}
+
+void IModelDnnDetector::InferRegions(Frame& frame, const cv::Mat& bgrFrame, std::vector<ODDetection>& detections) const {
+    if (!roi) {
+        InferArea(bgrFrame, detections);
+        return;
+    }
+
+    // The crop is a view, blobFromImage resizes straight from the frame rows
+    frame.regionDetections.clear();
+    InferArea(bgrFrame(roi->Bounds()), frame.regionDetections);
+    MapRegion(frame.regionDetections, detections);
+}
+
+void IModelDnnDetector::MapRegion(std::vector<ODDetection>& found, std::vector<ODDetection>& detections) const {
+    const cv::Point offset = roi->Bounds().tl();
+    for (auto& det : found) {
+        det.box += offset;
+        for (auto& point : det.landmarks) {
+            point += offset;
+        }
+        if (roi->Contains(det.box)) {
+            detections.push_back(std::move(det));
+        }
+    }
+}
+
+bool IModelDnnDetector::Detect(const OdBuf inBuf, OdBuf outBuf) const {
+    // One thread runs every stage, so the pass isn't split: the context stays leased
+    // through decoding, which reads the outputs in place
+    FrameLease frame = PrepareFrame(inBuf, false);
+    Forward(*frame);
+    Finish(*frame, outBuf);
+    return true;
+}
+
+bool IModelDnnDetector::Detect(const OdBuf inBuf, std::vector<ODDetection>& detections) const {
+    // A still frame isn't even converted
+    if (!CheckMotion(inBuf)) {
+        RecallDetections(detections);
+        return true;
+    }
+
+    FrameLease frame = frames.Acquire();
+    {
+        ODETECT_STAGE(Stage::Copy);
+        memcpy(frame->buffer.data(), inBuf, frame->buffer.size());
+    }
+
+    {
+        ODETECT_STAGE(Stage::Preprocess);
+        InputPreProcess(frame->buffer.data(), frame->image);
+    }
+
+    detections.clear();
+    InferRegions(*frame, frame->image, detections);
+    RememberDetections(detections);
+
+    return true;
+}
+
+IModelDnnDetector::FrameLease IModelDnnDetector::Prepare(const OdBuf inBuf) const {
+    return PrepareFrame(inBuf, true);
+}
+
+IModelDnnDetector::FrameLease IModelDnnDetector::PrepareFrame(const OdBuf inBuf, bool split) const {
+    FrameLease frame = frames.Acquire();
+    frame->infer = CheckMotion(inBuf);
+
+    {
+        ODETECT_STAGE(Stage::Copy);
+        memcpy(frame->buffer.data(), inBuf, frame->buffer.size());
+    }
+
+    {
+        ODETECT_STAGE(Stage::Preprocess);
+        InputPreProcess(frame->buffer.data(), frame->image);
+    }
+
+    // Tiles and refinement windows depend on the results of earlier passes
+    frame->staged = false;
+    if (split && frame->infer && !tileGrid && refineMax == 0) {
+        if (!frame->pass) {
+            frame->pass = NewPass();
+        }
+        frame->staged = frame->pass != nullptr;
+    }
+    if (frame->staged) {
+        frame->pass->Preprocess(roi ? frame->image(roi->Bounds()) : frame->image);
+    }
+    return frame;
+}
+
+void IModelDnnDetector::Forward(Frame& frame) const {
+    if (frame.staged) {
+        frame.pass->Forward();
+    } else if (frame.infer) {
+        frame.detections.clear();
+        InferRegions(frame, frame.image, frame.detections);
+    }
+}
+
+void IModelDnnDetector::Finish(Frame& frame, OdBuf outBuf) const {
+    std::vector<ODDetection>& detections = frame.detections;
+    if (frame.staged) {
+        detections.clear();
+        if (roi) {
+            frame.regionDetections.clear();
+            frame.pass->Decode(GetThreshold(), frame.regionDetections);
+            MapRegion(frame.regionDetections, detections);
+        } else {
+            frame.pass->Decode(GetThreshold(), detections);
+        }
+    }
+
+    if (frame.infer) {
+        RememberDetections(detections);
+    } else {
+        RecallDetections(detections);
+    }
+
+    {
+        ODETECT_STAGE(Stage::Draw);
+        DrawDetections(frame.image, detections);
+    }
+
+    ODETECT_STAGE(Stage::Copy);
+    memcpy(outBuf, frame.image.data, inCaps.width * inCaps.height * 3);
+}
+
+void IModelDnnDetector::WarmUpContexts(const cv::Mat& bgrFrame, int iterations) const {
+    std::vector<ODDetection> detections;
+    for (int i = 0; i < iterations; i++) {
+        detections.clear();
+        Infer(bgrFrame, GetThreshold(), detections);
+    }
+}
+
+double IModelDnnDetector::WarmUp(int iterations) const {
+    cv::Mat blank(inCaps.height, inCaps.width, CV_8UC3, cv::Scalar::all(0));
+
+    auto start = std::chrono::steady_clock::now();
+    WarmUpContexts(blank, iterations);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
\ No newline at end of file
@@ -23,6 +23,8 @@ THE SOFTWARE.
 */
 
 #include "models/ResNet10SSDFaceDetector.hpp"
+#include "factories/BackendFactory.hpp"
+#include "utils/Stage.hpp"
 
 #include <opencv2/imgcodecs.hpp>
 #include <opencv2/highgui.hpp>
@@ -30,58 +32,157 @@ THE SOFTWARE.
 #include <opencv2/objdetect.hpp>
 #include <opencv2/opencv.hpp>
 
+#include <algorithm>
 #include <cstdlib>
 #include <cstring>
 
 ResNet10SSDFaceDetector::ResNet10SSDFaceDetector(const std::string& modelDir, const ODCaps inCaps, const void* modelData) 
     : IModelDnnDetector(inCaps)
+    , contextPool([this]() {
+        auto context = std::make_unique<Context>();
+        context->backend = backend->CreateContext();
+        return context;
+    }, std::max(1, static_cast<const DetectorParams*>(modelData)->contexts))
 {
-    std::string modelConfiguration = modelDir + "/deploy.prototxt";
-    std::string modelWeights = modelDir + "/res10_300x300_ssd_iter_140000_fp16.caffemodel";
-    net = cv::dnn::readNetFromCaffe(modelConfiguration, modelWeights);
+    const DetectorParams& params = *static_cast<const DetectorParams*>(modelData);
+    contexts = std::max(1, params.contexts);
 
-    bufferSize = inCaps.width * inCaps.height * inCaps.channels;
-    buffer = new uint8_t[bufferSize];
+    BackendParams backendParams = params.backend;
+    // Fully convolutional, the prior boxes follow the input size
+    int side = params.inputSize > 0 ? params.inputSize : 300;
+    backendParams.inputSize = cv::Size(side, side);
+    inputSize = backendParams.inputSize;
 
-    float conf = *static_cast<const float*>(modelData);
+    std::string modelConfiguration = modelDir + "/deploy.prototxt";
+    std::string modelWeights = modelDir + "/res10_300x300_ssd_iter_140000.caffemodel";
+    std::string modelWeightsFp16 = modelDir + "/res10_300x300_ssd_iter_140000_fp16.caffemodel";
+    backend = BackendFactory::Create({
+        {ModelFormat::Caffe, Precision::FP32, modelWeights, modelConfiguration},
+        // fp16 stored weights are expanded to fp32 on load, so they serve fp32 too
+        {ModelFormat::Caffe, Precision::FP32, modelWeightsFp16, modelConfiguration},
+        {ModelFormat::Caffe, Precision::FP16, modelWeightsFp16, modelConfiguration},
+        // No tflite variant: TFLite has no DetectionOutput op, a converted SSD ends in raw
+        // box and score tensors that Decode doesn't read
+    }, backendParams);
+
+    float conf = params.threshold;
     modelThreshold = conf > 0 && conf <= 1 ? conf : modelThDefault;
+
+    // All contexts now, creating one mid-stream would stall the frame that needs it
+    contextPool.Reserve(contexts);
 }
 
 std::unique_ptr<IModelDnnDetector> ResNet10SSDFaceDetector::Construct(const std::string& modelDir, const ODCaps inCaps, const void* modelData) {
     return std::make_unique<ResNet10SSDFaceDetector>(modelDir, inCaps, modelData);
 }
 
+// The forward stage borrows a context for the pass and copies the outputs out of it
+class ResNet10SSDFaceDetector::Pass : public InferPass {
+private:
+    const ResNet10SSDFaceDetector& model;
+    cv::Mat blob;
+    std::vector<cv::Mat> outs;
+    cv::Size frameSize;
+
+public:
+    explicit Pass(const ResNet10SSDFaceDetector& model) : model(model) {}
 
-// TODO: probably pass to Interface
-ResNet10SSDFaceDetector::~ResNet10SSDFaceDetector() {
-    delete[] buffer;
+    void Preprocess(const cv::Mat& bgrFrame) override {
+        model.Preprocess(bgrFrame, blob);
+        frameSize = bgrFrame.size();
+    }
+
+    void Forward() override {
+        auto context = model.contextPool.Acquire();
+        context->backend->Forward(blob, context->outs);
+        ODETECT_STAGE(Stage::Copy);
+        outs.resize(context->outs.size());
+        for (size_t i = 0; i < outs.size(); i++) {
+            CopyOutput(context->outs[i], outs[i]);
+        }
+    }
+
+    void Decode(float threshold, std::vector<ODDetection>& detections) override {
+        model.Decode(outs[0], threshold, &frameSize, &detections, 1);
+    }
+};
+
+std::unique_ptr<InferPass> ResNet10SSDFaceDetector::NewPass() const {
+    return std::make_unique<Pass>(*this);
 }
 
-bool ResNet10SSDFaceDetector::Detect(const OdBuf inBuf, OdBuf outBuf) const {
-    memcpy(buffer, inBuf, bufferSize);
+void ResNet10SSDFaceDetector::WarmUpContexts(const cv::Mat& bgrFrame, int iterations) const {
+    // Held at once, so that every context runs its own passes
+    std::vector<ObjectPool<Context>::Lease> leases;
+    leases.reserve(contexts);
+    for (int i = 0; i < contexts; i++) {
+        leases.push_back(contextPool.Acquire());
+    }
+    for (auto& context : leases) {
+        Preprocess(bgrFrame, context->blob);
+        for (int i = 0; i < iterations; i++) {
+            context->backend->Forward(context->blob, context->outs);
+        }
+    }
+}
 
-    cv::Mat bgrFrame;
-    InputPreProcess(buffer, bgrFrame);
+void ResNet10SSDFaceDetector::Preprocess(const cv::Mat& bgrFrame, cv::Mat& blob) const {
+    ODETECT_STAGE(Stage::Preprocess);
+    cv::dnn::blobFromImage(bgrFrame, blob, 1.0, inputSize, cv::Scalar(104.0, 177.0, 123.0), false, false);
+}
 
-    cv::Mat input_blob = cv::dnn::blobFromImage(bgrFrame, 1.0, cv::Size(300, 300), cv::Scalar(104.0, 177.0, 123.0), false, false);
-    net.setInput(input_blob);
-    cv::Mat detection = net.forward();
-    cv::Mat detectionMat = cv::Mat(detection.size[2], detection.size[3], CV_32F, detection.ptr<float>());
+void ResNet10SSDFaceDetector::Decode(const cv::Mat& out, float threshold, const cv::Size* frameSizes, std::vector<ODDetection>* detections, size_t count) const {
+    ODETECT_STAGE(Stage::Decode);
+    // A 2D header over the blob, copying the 4D one would allocate
+    cv::Mat detectionMat(out.size[2], out.size[3], CV_32F, const_cast<float*>(out.ptr<float>()));
 
     for (int i = 0; i < detectionMat.rows; i++) {
+        int image = static_cast<int>(detectionMat.at<float>(i, 0));
         float confidence = detectionMat.at<float>(i, 2);
 
-        if (confidence > modelThreshold) {
-            int x1 = static_cast<int>(detectionMat.at<float>(i, 3) * bgrFrame.cols);
-            int y1 = static_cast<int>(detectionMat.at<float>(i, 4) * bgrFrame.rows);
-            int x2 = static_cast<int>(detectionMat.at<float>(i, 5) * bgrFrame.cols);
-            int y2 = static_cast<int>(detectionMat.at<float>(i, 6) * bgrFrame.rows);
+        if (image >= 0 && static_cast<size_t>(image) < count && confidence > threshold) {
+            const cv::Size& size = frameSizes[image];
+            int x1 = static_cast<int>(detectionMat.at<float>(i, 3) * size.width);
+            int y1 = static_cast<int>(detectionMat.at<float>(i, 4) * size.height);
+            int x2 = static_cast<int>(detectionMat.at<float>(i, 5) * size.width);
+            int y2 = static_cast<int>(detectionMat.at<float>(i, 6) * size.height);
 
-            cv::rectangle(bgrFrame, cv::Point(x1, y1), cv::Point(x2, y2), cv::Scalar(0, 255, 0), 3, 8);
+            detections[image].push_back({cv::Rect(cv::Point(x1, y1), cv::Point(x2, y2)), confidence, {}});
         }
     }
+}
+
+void ResNet10SSDFaceDetector::Infer(const cv::Mat& bgrFrame, float threshold, std::vector<ODDetection>& detections) const {
+    auto context = contextPool.Acquire();
+    Preprocess(bgrFrame, context->blob);
+    context->backend->Forward(context->blob, context->outs);
+
+    cv::Size frameSize = bgrFrame.size();
+    Decode(context->outs[0], threshold, &frameSize, &detections, 1);
+}
+
+// Tiles go through the network as one blob, detection_out tags rows with the image
+void ResNet10SSDFaceDetector::InferBatch(const std::vector<cv::Mat>& bgrFrames, float threshold, std::vector<std::vector<ODDetection>>& detections) const {
+    if (!backend->SupportsBatch()) {
+        IModelDnnDetector::InferBatch(bgrFrames, threshold, detections);
+        return;
+    }
 
-    memcpy(outBuf, bgrFrame.data, inCaps.width * inCaps.height * 3);
+    auto context = contextPool.Acquire();
+    {
+        ODETECT_STAGE(Stage::Preprocess);
+        cv::dnn::blobFromImages(bgrFrames, context->blob, 1.0, inputSize, cv::Scalar(104.0, 177.0, 123.0), false, false);
+    }
+    context->backend->Forward(context->blob, context->outs);
 
-    return true;
+    std::vector<cv::Size>& batchSizes = context->batchSizes;
+    batchSizes.clear();
+    for (const auto& frame : bgrFrames) {
+        batchSizes.push_back(frame.size());
+    }
+    detections.resize(bgrFrames.size());
+    for (auto& frameDetections : detections) {
+        frameDetections.clear();
+    }
+    Decode(context->outs[0], threshold, batchSizes.data(), detections.data(), detections.size());
 }
\ No newline at end of file
@@ -0,0 +1,144 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "models/SsdYoloCascadeDetector.hpp"
+#include "utils/Stage.hpp"
+
+#include <opencv2/dnn.hpp>
+#include <algorithm>
+
+SsdYoloCascadeDetector::SsdYoloCascadeDetector(const std::string& modelDir, const ODCaps inCaps, const void* modelData)
+    : IModelDnnDetector(inCaps)
+{
+    const DetectorParams& params = *static_cast<const DetectorParams*>(modelData);
+
+    // The input size only scales the gate, YOLO sees crops
+    DetectorParams refinerParams = params;
+    refinerParams.inputSize = cropInputSize;
+    gate = std::make_unique<ResNet10SSDFaceDetector>(modelDir, inCaps, modelData);
+    refiner = std::make_unique<Yolo5sPersonDetector>(modelDir, inCaps, &refinerParams);
+    inputSize = gate->InputSize();
+    contexts = std::max(1, params.contexts);
+
+    float conf = params.threshold;
+    modelThreshold = conf > 0 && conf <= 1 ? conf : modelThDefault;
+}
+
+std::unique_ptr<IModelDnnDetector> SsdYoloCascadeDetector::Construct(const std::string& modelDir, const ODCaps inCaps, const void* modelData) {
+    return std::make_unique<SsdYoloCascadeDetector>(modelDir, inCaps, modelData);
+}
+
+void SsdYoloCascadeDetector::WarmUpContexts(const cv::Mat&, int iterations) const {
+    gate->WarmUp(iterations);
+    refiner->WarmUp(iterations);
+}
+
+void SsdYoloCascadeDetector::Infer(const cv::Mat& bgrFrame, float threshold, std::vector<ODDetection>& detections) const {
+    auto lists = scratch.Acquire();
+    lists->Clear();
+    std::vector<ODDetection>& hits = lists->found;
+    gate->Infer(bgrFrame, std::min(threshold, gateThresholdMax), hits);
+    if (hits.empty()) {
+        return;
+    }
+
+    const cv::Rect frame(0, 0, bgrFrame.cols, bgrFrame.rows);
+    std::vector<cv::Rect>& crops = lists->windows;
+    std::vector<cv::Mat>& views = lists->views;
+    {
+        ODETECT_STAGE(Stage::Decode);
+        // Bounds the YOLO passes per frame
+        if (hits.size() > maxCrops) {
+            std::partial_sort(hits.begin(), hits.begin() + maxCrops, hits.end(), [](const ODDetection& a, const ODDetection& b) {
+                return a.confidence > b.confidence;
+            });
+        }
+
+        double cropsArea = 0;
+        for (size_t i = 0; i < std::min(hits.size(), maxCrops); i++) {
+            const ODDetection& hit = hits[i];
+            int side = static_cast<int>(std::max(hit.box.width, hit.box.height) * cropScale);
+            cv::Rect crop(hit.box.x + hit.box.width / 2 - side / 2, hit.box.y + hit.box.height / 2 - side / 2, side, side);
+            crop &= frame;
+            if (!crop.empty()) {
+                crops.push_back(crop);
+                cropsArea += crop.area();
+            }
+        }
+        // Faces this big are easy for the SSD, and YOLO at the crop input would see the
+        // frame at a quarter of its scale at best: the SSD boxes are kept as they are
+        if (cropsArea > fullFrameArea * frame.area()) {
+            crops.clear();
+        }
+
+        for (const auto& crop : crops) {
+            views.push_back(bgrFrame(crop));
+        }
+    }
+
+    std::vector<std::vector<ODDetection>>& refined = lists->batch;
+    if (!views.empty()) {
+        refiner->InferBatch(views, threshold, refined);
+        views.clear();
+    }
+
+    std::vector<ODDetection>& results = lists->results;
+    std::vector<cv::Rect>& boxes = lists->boxes;
+    std::vector<float>& scores = lists->scores;
+    {
+        ODETECT_STAGE(Stage::Decode);
+        for (size_t i = 0; i < crops.size(); i++) {
+            const cv::Point offset = crops[i].tl();
+            for (auto& det : refined[i]) {
+                det.box += offset;
+                for (auto& point : det.landmarks) {
+                    point += offset;
+                }
+                results.push_back(std::move(det));
+            }
+        }
+        // Confident SSD boxes YOLO missed stay, without landmarks
+        for (auto& hit : hits) {
+            if (hit.confidence >= threshold) {
+                results.push_back(std::move(hit));
+            }
+        }
+
+        // Refined boxes win over the SSD ones they overlap
+        for (const auto& det : results) {
+            boxes.push_back(det.box);
+            scores.push_back(det.landmarks.empty() ? det.confidence * 0.5f : 1.0f + det.confidence);
+        }
+    }
+
+    std::vector<int>& indices = lists->indices;
+    {
+        ODETECT_STAGE(Stage::Nms);
+        cv::dnn::NMSBoxes(boxes, scores, 0, nmsThreshold, indices);
+    }
+    ODETECT_STAGE(Stage::Decode);
+    for (int idx : indices) {
+        detections.push_back(std::move(results[idx]));
+    }
+}
\ No newline at end of file
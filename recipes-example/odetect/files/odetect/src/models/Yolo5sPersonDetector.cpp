@@ -23,10 +23,14 @@ THE SOFTWARE.
 */
 
 #include "models/Yolo5sPersonDetector.hpp"
+#include "factories/BackendFactory.hpp"
+#include "utils/Stage.hpp"
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
+#include <algorithm>
+#include <stdexcept>
 
 const std::string Yolo5sPersonDetector::modelName = "yolov5s-face.onnx";
 using namespace std;
@@ -39,28 +43,46 @@ static inline float sigmoid_x(float x)
 
 Yolo5sPersonDetector::Yolo5sPersonDetector(const std::string& modelDir, const ODCaps inCaps, const void* modelData) 
     : IModelDnnDetector(inCaps)
+    , contextPool([this]() {
+        auto context = std::make_unique<Context>();
+        context->backend = backend->CreateContext();
+        return context;
+    }, std::max(1, static_cast<const DetectorParams*>(modelData)->contexts))
 {
-    std::string modelPath = modelDir + "/" + modelName;
-    net = cv::dnn::readNetFromONNX(modelPath);
+    const DetectorParams& params = *static_cast<const DetectorParams*>(modelData);
+    contexts = std::max(1, params.contexts);
 
-    net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
-    net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
-    bufferSize = inCaps.width * inCaps.height * inCaps.channels;
-    buffer = new uint8_t[bufferSize];
+    if (params.inputSize > 0) {
+        if (params.inputSize % 32) {
+            throw std::runtime_error("YOLOv5 input size must be a multiple of 32");
+        }
+        m_width = m_height = params.inputSize;
+    }
 
-	float conf = *static_cast<const float*>(modelData);
-    objThreshold = conf > 0 && conf <= 1 ? conf : modelThDefault;
-	confThreshold = objThreshold;
+    std::string modelPath = modelDir + "/" + modelName;
+    BackendParams backendParams = params.backend;
+    backendParams.inputSize = cv::Size(m_width, m_height);
+    inputSize = backendParams.inputSize;
+    backend = BackendFactory::Create({
+        {ModelFormat::Onnx, Precision::FP32, modelPath, ""},
+        {ModelFormat::Onnx, Precision::FP16, modelPath, ""},
+        {ModelFormat::Onnx, Precision::INT8, modelDir + "/yolov5s-face_int8.onnx", ""},
+        {ModelFormat::TfLite, Precision::FP32, modelDir + "/yolov5s-face.tflite", ""},
+        {ModelFormat::TfLite, Precision::FP16, modelDir + "/yolov5s-face_fp16.tflite", ""},
+        {ModelFormat::TfLite, Precision::INT8, modelDir + "/yolov5s-face_int8.tflite", ""},
+    }, backendParams);
+
+	float conf = params.threshold;
+    modelThreshold = conf > 0 && conf <= 1 ? conf : modelThDefault;
+
+    // All contexts now, creating one mid-stream would stall the frame that needs it
+    contextPool.Reserve(contexts);
 }
 
 std::unique_ptr<IModelDnnDetector> Yolo5sPersonDetector::Construct(const std::string& modelDir, const ODCaps inCaps, const void* modelData) {
     return std::make_unique<Yolo5sPersonDetector>(modelDir, inCaps, modelData);
 }
 
-Yolo5sPersonDetector::~Yolo5sPersonDetector() {
-    delete[] buffer;
-}
-
 void Yolo5sPersonDetector::Sigmoid(cv::Mat* out, int length)
 {
 	float* pdata = (float*)(out->data);
@@ -70,85 +92,130 @@ void Yolo5sPersonDetector::Sigmoid(cv::Mat* out, int length)
 	}
 }
 
-void Yolo5sPersonDetector::drawPred(float conf, int left, int top, int right, int bottom, Mat& frame, std::vector<int> landmark) const
-{
-	//Draw a rectangle displaying the bounding box
-	cv::rectangle(frame, Point(left, top), Point(right, bottom), Scalar(0, 255, 0), 3);
-	
-    //Draw key points
-    for (int i = 0; i < 5; i++) {
-		cv::circle(frame, cv::Point(landmark[2 * i], landmark[2 * i + 1]), 5, cv::Scalar(0, 0, 255), -1);
+// The forward stage borrows a context for the pass and copies the output out of it
+class Yolo5sPersonDetector::Pass : public InferPass {
+private:
+	const Yolo5sPersonDetector& model;
+	cv::Mat blob;
+	cv::Mat out;
+	cv::Size frameSize;
+	Candidates candidates;
+
+public:
+	explicit Pass(const Yolo5sPersonDetector& model) : model(model) {}
+
+	void Preprocess(const cv::Mat& bgrFrame) override {
+		model.Preprocess(bgrFrame, blob);
+		frameSize = bgrFrame.size();
 	}
-}
 
-bool Yolo5sPersonDetector::Detect(const OdBuf inBuf, OdBuf outBuf) const {
-    memcpy(buffer, inBuf, bufferSize);
+	void Forward() override {
+		auto context = model.contextPool.Acquire();
+		context->backend->Forward(blob, context->outs);
+		ODETECT_STAGE(Stage::Copy);
+		CopyOutput(context->outs[0], out);
+	}
 
-    cv::Mat bgrFrame;
-    InputPreProcess(buffer, bgrFrame);
+	void Decode(float threshold, std::vector<ODDetection>& detections) override {
+		model.Decode(out, frameSize, threshold, candidates, detections);
+	}
+};
 
-	cv::Mat input_blob = cv::dnn::blobFromImage(bgrFrame, 1 / 255.0, cv::Size(m_width, m_height), cv::Scalar(0, 0, 0), true, false);
-	net.setInput(input_blob);
+std::unique_ptr<InferPass> Yolo5sPersonDetector::NewPass() const {
+	return std::make_unique<Pass>(*this);
+}
 
-	std::vector<cv::Mat> outs;
-	this->net.forward(outs, this->net.getUnconnectedOutLayersNames());
+void Yolo5sPersonDetector::WarmUpContexts(const cv::Mat& bgrFrame, int iterations) const {
+	// Held at once, so that every context runs its own passes
+	std::vector<ObjectPool<Context>::Lease> leases;
+	leases.reserve(contexts);
+	for (int i = 0; i < contexts; i++) {
+		leases.push_back(contextPool.Acquire());
+	}
+	for (auto& context : leases) {
+		Preprocess(bgrFrame, context->blob);
+		for (int i = 0; i < iterations; i++) {
+			context->backend->Forward(context->blob, context->outs);
+		}
+	}
+}
 
-	std::vector<float> confidences;
-	std::vector<Rect> boxes;
-	std::vector<std::vector<int>> landmarks;
-	float ratioh = (float)bgrFrame.rows / m_height, ratiow = (float)bgrFrame.cols / m_width;
+void Yolo5sPersonDetector::Preprocess(const cv::Mat& bgrFrame, cv::Mat& blob) const {
+	ODETECT_STAGE(Stage::Preprocess);
+	cv::dnn::blobFromImage(bgrFrame, blob, 1 / 255.0, cv::Size(m_width, m_height), cv::Scalar(0, 0, 0), true, false);
+}
+
+void Yolo5sPersonDetector::Infer(const cv::Mat& bgrFrame, float threshold, std::vector<ODDetection>& detections) const {
+	auto context = contextPool.Acquire();
+	Preprocess(bgrFrame, context->blob);
+	context->backend->Forward(context->blob, context->outs);
+	Decode(context->outs[0], bgrFrame.size(), threshold, context->candidates, detections);
+}
+
+void Yolo5sPersonDetector::Decode(const cv::Mat& out, const cv::Size& frameSize, float threshold, Candidates& candidates, std::vector<ODDetection>& detections) const {
+	std::vector<float>& confidences = candidates.confidences;
+	std::vector<cv::Rect>& boxes = candidates.boxes;
+	std::vector<int>& landmarks = candidates.landmarks;
+	std::vector<int>& indices = candidates.indices;
+
+	const float objThreshold = threshold;
+	const float confThreshold = objThreshold;
+	confidences.clear();
+	boxes.clear();
+	landmarks.clear();
+	float ratioh = (float)frameSize.height / m_height, ratiow = (float)frameSize.width / m_width;
 	int n = 0, q = 0, i = 0, j = 0, nout = 16, row_ind = 0, k = 0; ///xmin,ymin,xamx,ymax,box_score,x1,y1, ... ,x5,y5,face_score
-	for (n = 0; n < 3; n++) {
-		int num_grid_x = (int)(m_width / this->stride[n]);
-		int num_grid_y = (int)(m_height / this->stride[n]);
-		for (q = 0; q < 3; q++) {
-			const float anchor_w = this->anchors[n][q * 2];
-			const float anchor_h = this->anchors[n][q * 2 + 1];
-			for (i = 0; i < num_grid_y; i++) {
-				for (j = 0; j < num_grid_x; j++) {
-					float* pdata = (float*)outs[0].data + row_ind * nout;
-					float box_score = sigmoid_x(pdata[4]);
-					if (box_score > objThreshold) {
-						float face_score = sigmoid_x(pdata[15]);
-						// if (face_score > confThreshold) { 
-							float cx = (sigmoid_x(pdata[0]) * 2.f - 0.5f + j) * this->stride[n];  ///cx
-							float cy = (sigmoid_x(pdata[1]) * 2.f - 0.5f + i) * this->stride[n];   ///cy
-							float w = powf(sigmoid_x(pdata[2]) * 2.f, 2.f) * anchor_w;   ///w
-							float h = powf(sigmoid_x(pdata[3]) * 2.f, 2.f) * anchor_h;  ///h
-
-							int left = (cx - 0.5*w)*ratiow;
-							int top = (cy - 0.5*h)*ratioh;   
-
-							confidences.push_back(face_score);
-							boxes.push_back(Rect(left, top, (int)(w*ratiow), (int)(h*ratioh)));
-							std::vector<int> landmark(10);
-							for (k = 5; k < 15; k+=2) {
-								const int ind = k - 5;
-								landmark[ind] = (int)(pdata[k] * anchor_w + j * this->stride[n])*ratiow;
-								landmark[ind + 1] = (int)(pdata[k + 1] * anchor_h + i * this->stride[n])*ratioh;
-							}
-							landmarks.push_back(landmark);
-						// }
+	{
+		ODETECT_STAGE(Stage::Decode);
+		for (n = 0; n < 3; n++) {
+			int num_grid_x = (int)(m_width / this->stride[n]);
+			int num_grid_y = (int)(m_height / this->stride[n]);
+			for (q = 0; q < 3; q++) {
+				const float anchor_w = this->anchors[n][q * 2];
+				const float anchor_h = this->anchors[n][q * 2 + 1];
+				for (i = 0; i < num_grid_y; i++) {
+					for (j = 0; j < num_grid_x; j++) {
+						float* pdata = (float*)out.data + row_ind * nout;
+						float box_score = sigmoid_x(pdata[4]);
+						if (box_score > objThreshold) {
+							float face_score = sigmoid_x(pdata[15]);
+							// if (face_score > confThreshold) { 
+								float cx = (sigmoid_x(pdata[0]) * 2.f - 0.5f + j) * this->stride[n];  ///cx
+								float cy = (sigmoid_x(pdata[1]) * 2.f - 0.5f + i) * this->stride[n];   ///cy
+								float w = powf(sigmoid_x(pdata[2]) * 2.f, 2.f) * anchor_w;   ///w
+								float h = powf(sigmoid_x(pdata[3]) * 2.f, 2.f) * anchor_h;  ///h
+
+								int left = (cx - 0.5*w)*ratiow;
+								int top = (cy - 0.5*h)*ratioh;   
+
+								confidences.push_back(face_score);
+								boxes.push_back(Rect(left, top, (int)(w*ratiow), (int)(h*ratioh)));
+								for (k = 5; k < 15; k+=2) {
+									landmarks.push_back((int)(pdata[k] * anchor_w + j * this->stride[n])*ratiow);
+									landmarks.push_back((int)(pdata[k + 1] * anchor_h + i * this->stride[n])*ratioh);
+								}
+							// }
+						}
+						row_ind++;
 					}
-					row_ind++;
 				}
 			}
 		}
 	}
 
-	std::vector<int> indices;
-	cv::dnn::NMSBoxes(boxes, confidences, confThreshold, nmsThreshold, indices);
+	{
+		ODETECT_STAGE(Stage::Nms);
+		cv::dnn::NMSBoxes(boxes, confidences, confThreshold, nmsThreshold, indices);
+	}
+
+	ODETECT_STAGE(Stage::Decode);
 	for (size_t i = 0; i < indices.size(); ++i) {
 		int idx = indices[i];
-		cv::Rect box = boxes[idx];
-
-		drawPred(confidences[idx], box.x, box.y,
-			box.x + box.width, box.y + box.height, bgrFrame, landmarks[idx]);
-
+		const int* landmark = &landmarks[idx * 10];
+		ODDetection detection = {boxes[idx], confidences[idx], {}};
+		for (k = 0; k < 5; k++) {
+			detection.landmarks.push_back(cv::Point(landmark[2 * k], landmark[2 * k + 1]));
+		}
+		detections.push_back(detection);
 	}
-
-
-    memcpy(outBuf, bgrFrame.data, inCaps.width * inCaps.height * 3);
-
-    return true;
 }
\ No newline at end of file
@@ -0,0 +1,218 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "runtime/AdaptiveLadder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+std::vector<AdaptiveLadder::Rung> AdaptiveLadder::ParseLadder(const std::string& spec) {
+    std::vector<Rung> rungs;
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        auto sep = item.find('@');
+        Rung rung = {item.substr(0, sep), 0};
+        if (sep != std::string::npos) {
+            try {
+                rung.inputSize = std::stoi(item.substr(sep + 1));
+            } catch (std::exception&) {
+                throw std::runtime_error("Incorrect ladder rung: " + item);
+            }
+        }
+        if (rung.model.empty() || rung.inputSize < 0) {
+            throw std::runtime_error("Incorrect ladder rung: " + item);
+        }
+        rungs.push_back(rung);
+    }
+
+    if (rungs.size() < 2) {
+        throw std::runtime_error("A ladder needs at least two rungs");
+    }
+    return rungs;
+}
+
+AdaptiveLadder::AdaptiveLadder(DetectorSlot& slot, const std::vector<Rung>& rungs, double budgetMs)
+    : slot(slot), rungs(rungs), budgetMs(budgetMs), current(0), pending(0), onLadder(true), loadsSeen(slot.Loads()),
+      calmWindows(0), discardWindow(false), cpuBusy(0), cpuTotal(0), selfBusy(0)
+{
+    if (budgetMs <= 0) {
+        throw std::runtime_error("Latency budget must be positive");
+    }
+    latencies.reserve(windowFrames);
+    CpuLoad();
+}
+
+AdaptiveLadder::~AdaptiveLadder() {
+    if (switching.valid()) {
+        switching.wait();
+    }
+}
+
+// All CPUs from /proc/stat, minus odetect's own user and system time from
+// /proc/self/stat, both in clock ticks
+double AdaptiveLadder::CpuLoad() {
+    std::ifstream stat("/proc/stat");
+    std::string cpu;
+    uint64_t user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0;
+    if (!(stat >> cpu >> user >> nice >> system >> idle >> iowait >> irq >> softirq >> steal)) {
+        return 0;
+    }
+
+    // The name in parentheses may hold spaces, utime and stime are the 12th and 13th
+    // fields after it
+    std::ifstream selfStat("/proc/self/stat");
+    std::string line;
+    std::getline(selfStat, line);
+    std::istringstream fields(line.substr(line.rfind(')') + 1));
+    std::string skipped;
+    int skip = 11;
+    while (skip > 0 && fields >> skipped) {
+        skip--;
+    }
+    uint64_t selfUser = 0, selfSystem = 0;
+    if (!(fields >> selfUser >> selfSystem)) {
+        return 0;
+    }
+
+    uint64_t busy = user + nice + system + irq + softirq + steal;
+    uint64_t total = busy + idle + iowait;
+    uint64_t self = selfUser + selfSystem;
+    double load = 0;
+    if (total > cpuTotal) {
+        // Clock ticks are sampled, the difference may dip below zero
+        int64_t others = static_cast<int64_t>(busy - cpuBusy) - static_cast<int64_t>(self - selfBusy);
+        load = std::max<int64_t>(others, 0) / static_cast<double>(total - cpuTotal);
+    }
+    cpuBusy = busy;
+    cpuTotal = total;
+    selfBusy = self;
+    return load;
+}
+
+void AdaptiveLadder::Resync() {
+    loadsSeen = slot.Loads();
+    std::string name = slot.Name();
+    auto detector = slot.Get();
+    int size = detector ? detector->InputSize().width : 0;
+
+    // An exact size first, a rung at the model default otherwise
+    onLadder = false;
+    for (size_t i = 0; i < rungs.size(); i++) {
+        if (rungs[i].model != name) {
+            continue;
+        }
+        if (rungs[i].inputSize == size) {
+            current = i;
+            onLadder = true;
+            break;
+        }
+        if (rungs[i].inputSize == 0 && !onLadder) {
+            current = i;
+            onLadder = true;
+        }
+    }
+    calmWindows = 0;
+    latencies.clear();
+    discardWindow = true;
+
+    if (onLadder) {
+        std::cout << "Adaptive ladder: " << name << " loaded from outside, at rung " << current + 1 << std::endl;
+    } else {
+        std::cout << "Adaptive ladder: " << name << " loaded from outside isn't on the ladder, paused" << std::endl;
+    }
+}
+
+void AdaptiveLadder::OnFrame(double latencyMs) {
+    if (switching.valid()) {
+        if (switching.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return;
+        }
+        try {
+            loadsSeen = switching.get().loads;
+            current = pending;
+            onLadder = true;
+        } catch (std::exception& e) {
+            std::cerr << "Adaptive ladder: can't load " << rungs[pending].model << ": " << e.what() << std::endl;
+        }
+        latencies.clear();
+        discardWindow = true;
+    }
+    if (slot.Loads() != loadsSeen) {
+        Resync();
+    }
+
+    latencies.push_back(latencyMs);
+    if (latencies.size() >= windowFrames) {
+        Evaluate();
+        latencies.clear();
+    }
+}
+
+void AdaptiveLadder::Evaluate() {
+    double cpu = CpuLoad();
+    // The first window after a swap still carries the warm-up and the old model's backlog
+    if (discardWindow || !onLadder) {
+        discardWindow = false;
+        return;
+    }
+
+    auto p90 = latencies.begin() + latencies.size() * 9 / 10;
+    std::nth_element(latencies.begin(), p90, latencies.end());
+    double latency = *p90;
+
+    if (latency > budgetMs || cpu > cpuHigh) {
+        calmWindows = 0;
+        if (current + 1 < rungs.size()) {
+            std::cout << "Adaptive ladder: p90 " << latency << " ms, cpu " << static_cast<int>(cpu * 100) << "%, stepping down" << std::endl;
+            Switch(current + 1);
+        }
+    } else if (latency < budgetMs * upgradeHeadroom && cpu < cpuCalm) {
+        if (current > 0 && ++calmWindows >= upgradeWindows) {
+            calmWindows = 0;
+            std::cout << "Adaptive ladder: p90 " << latency << " ms, cpu " << static_cast<int>(cpu * 100) << "%, stepping up" << std::endl;
+            Switch(current - 1);
+        }
+    } else {
+        calmWindows = 0;
+    }
+}
+
+void AdaptiveLadder::Switch(size_t rung) {
+    pending = rung;
+    Rung target = rungs[rung];
+    std::cout << "Adaptive ladder: switching to " << target.model;
+    if (target.inputSize) {
+        std::cout << "@" << target.inputSize;
+    }
+    std::cout << std::endl;
+
+    switching = std::async(std::launch::async, [this, target]() {
+        return slot.Load(target.model, 0, target.inputSize);
+    });
+}
\ No newline at end of file
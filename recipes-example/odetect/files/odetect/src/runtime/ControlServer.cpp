@@ -0,0 +1,199 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "runtime/ControlServer.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+ControlServer::ControlServer(const std::string& path, DetectorSlot& slot, StatsProvider stats)
+    : slot(slot), stats(std::move(stats)), path(path), running(true)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Control socket path is too long: " + path);
+    }
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listenFd < 0) {
+        throw std::runtime_error("Can't open control socket");
+    }
+
+    unlink(path.c_str());
+    if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(listenFd, 4) != 0) {
+        close(listenFd);
+        throw std::runtime_error("Can't listen on control socket " + path);
+    }
+    if (pipe2(stopPipe, O_CLOEXEC) != 0) {
+        close(listenFd);
+        throw std::runtime_error("Can't create control socket stop pipe");
+    }
+
+    worker = std::thread(&ControlServer::Run, this);
+}
+
+ControlServer::~ControlServer() {
+    running = false;
+    // Wakes up the wait for a client or its command
+    char stop = 0;
+    if (write(stopPipe[1], &stop, 1) < 0) {
+        shutdown(listenFd, SHUT_RDWR);
+    }
+    worker.join();
+    close(stopPipe[0]);
+    close(stopPipe[1]);
+    close(listenFd);
+    unlink(path.c_str());
+}
+
+bool ControlServer::WaitReadable(int fd, int timeoutMs) {
+    pollfd fds[2] = {{fd, POLLIN, 0}, {stopPipe[0], POLLIN, 0}};
+    int ready;
+    do {
+        ready = poll(fds, 2, timeoutMs);
+    } while (ready < 0 && errno == EINTR);
+    return ready > 0 && !(fds[1].revents & POLLIN) && running;
+}
+
+void ControlServer::Run() {
+    while (running) {
+        if (!WaitReadable(listenFd, -1)) {
+            continue;
+        }
+        int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN) {
+                continue;
+            }
+            if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                // Out of resources for now, retry later instead of spinning
+                std::cerr << "Control socket: accept failed: " << strerror(errno) << std::endl;
+                WaitReadable(stopPipe[0], 1000);
+                continue;
+            }
+            std::cerr << "Control socket: accept failed: " << strerror(errno) << ", closing it" << std::endl;
+            return;
+        }
+
+        // An idle client doesn't hold up the server nor its shutdown
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(clientTimeoutMs);
+        std::string command;
+        char chunk[256];
+        while (command.find('\n') == std::string::npos) {
+            int left = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+            if (left <= 0 || !WaitReadable(client, left)) {
+                break;
+            }
+            ssize_t len = read(client, chunk, sizeof(chunk));
+            if (len <= 0) {
+                break;
+            }
+            command.append(chunk, len);
+        }
+        if (!running) {
+            close(client);
+            break;
+        }
+
+        // A client may give up before its reply, a model swap takes seconds: MSG_NOSIGNAL
+        // turns that into EPIPE instead of a SIGPIPE killing the process
+        std::string reply = Handle(command.substr(0, command.find('\n'))) + "\n";
+        size_t sent = 0;
+        while (sent < reply.size()) {
+            ssize_t len = send(client, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+            if (len >= 0) {
+                sent += len;
+            } else if (errno != EINTR) {
+                if (errno == EPIPE || errno == ECONNRESET) {
+                    std::cerr << "Control client went away" << std::endl;
+                } else {
+                    std::cerr << "Control socket: reply failed: " << strerror(errno) << std::endl;
+                }
+                break;
+            }
+        }
+        close(client);
+    }
+}
+
+std::string ControlServer::Handle(const std::string& command) {
+    std::istringstream ss(command);
+    std::string verb;
+    ss >> verb;
+
+    try {
+        if (verb == "threshold") {
+            float threshold;
+            if (!(ss >> threshold)) {
+                return "error threshold <value> expected";
+            }
+            slot.SetThreshold(threshold);
+            std::cout << "Threshold changed to " << threshold << std::endl;
+            return "ok threshold " + std::to_string(threshold);
+        } else if (verb == "model") {
+            std::string name;
+            float threshold = 0;
+            if (!(ss >> name)) {
+                return "error model <name> [threshold] expected";
+            }
+            ss >> threshold;
+
+            DetectorSlot::LoadTiming timing = slot.Load(name, threshold);
+            std::ostringstream reply;
+            reply << "ok model " << name << " load_ms " << timing.loadMs << " warmup_ms " << timing.warmUpMs;
+            std::cout << "Model swapped: " << reply.str().substr(3) << std::endl;
+            return reply.str();
+        } else if (verb == "status") {
+            auto detector = slot.Get();
+            std::ostringstream reply;
+            reply << "ok model " << slot.Name();
+            if (detector) {
+                reply << " input " << detector->InputSize().width << "x" << detector->InputSize().height
+                      << " threshold " << detector->GetThreshold();
+            }
+            return reply.str();
+        } else if (verb == "stats") {
+            if (!stats) {
+                return "error no stats";
+            }
+            return "ok " + stats();
+        }
+    } catch (const std::exception& e) {
+        return std::string("error ") + e.what();
+    }
+
+    return "error unknown command: " + verb;
+}
\ No newline at end of file
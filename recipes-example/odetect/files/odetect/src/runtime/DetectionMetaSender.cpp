@@ -0,0 +1,91 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "runtime/DetectionMetaSender.hpp"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+
+DetectionMetaSender::DetectionMetaSender(const std::string& ip, const std::string& port, const ODCaps& inferCaps, const ODCaps& streamCaps)
+    : scaleX(static_cast<double>(streamCaps.width) / inferCaps.width),
+      scaleY(static_cast<double>(streamCaps.height) / inferCaps.height)
+{
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    addrinfo* res = nullptr;
+    if (getaddrinfo(ip.c_str(), port.c_str(), &hints, &res) != 0 || !res) {
+        throw std::runtime_error("Can't resolve metadata destination " + ip + ":" + port);
+    }
+    memcpy(&dst, res->ai_addr, sizeof(dst));
+    freeaddrinfo(res);
+
+    sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        throw std::runtime_error("Can't open metadata socket");
+    }
+
+    message.reserve(4096);
+}
+
+DetectionMetaSender::~DetectionMetaSender() {
+    close(sock);
+}
+
+bool DetectionMetaSender::Send(uint64_t seq, uint64_t pts, const std::vector<ODDetection>& detections) {
+    char item[128];
+
+    message.clear();
+    snprintf(item, sizeof(item), "{\"seq\":%llu,\"pts\":%llu,\"detections\":[",
+        static_cast<unsigned long long>(seq), static_cast<unsigned long long>(pts));
+    message += item;
+
+    for (size_t i = 0; i < detections.size(); i++) {
+        const ODDetection& det = detections[i];
+        snprintf(item, sizeof(item), "%s{\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d,\"conf\":%.3f,\"landmarks\":[",
+            i ? "," : "",
+            static_cast<int>(det.box.x * scaleX), static_cast<int>(det.box.y * scaleY),
+            static_cast<int>(det.box.width * scaleX), static_cast<int>(det.box.height * scaleY),
+            det.confidence);
+        message += item;
+
+        for (size_t k = 0; k < det.landmarks.size(); k++) {
+            snprintf(item, sizeof(item), "%s%d,%d", k ? "," : "",
+                static_cast<int>(det.landmarks[k].x * scaleX), static_cast<int>(det.landmarks[k].y * scaleY));
+            message += item;
+        }
+        message += "]}";
+    }
+    message += "]}";
+
+    ssize_t sent = sendto(sock, message.data(), message.size(), 0, reinterpret_cast<const sockaddr*>(&dst), sizeof(dst));
+    return sent == static_cast<ssize_t>(message.size());
+}
\ No newline at end of file
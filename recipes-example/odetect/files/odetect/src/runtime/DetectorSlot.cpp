@@ -0,0 +1,138 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "runtime/DetectorSlot.hpp"
+#include "factories/ModelFactory.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+DetectorSlot::DetectorSlot(const std::string& modelDir, const ODCaps& inCaps, ParamsResolver resolver, int warmup)
+    : thresholdOverride(0), thresholdChanges(0), loads(0), modelDir(modelDir), inCaps(inCaps), resolver(std::move(resolver)), warmup(warmup)
+{
+}
+
+std::shared_ptr<IModelDnnDetector> DetectorSlot::Get() const {
+    return std::atomic_load(&active);
+}
+
+std::string DetectorSlot::Name() const {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    return activeName;
+}
+
+uint64_t DetectorSlot::Loads() const {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    return loads;
+}
+
+DetectorSlot::LoadTiming DetectorSlot::Load(const std::string& modelName, float threshold, int inputSize) {
+    std::lock_guard<std::mutex> lock(loadMutex);
+
+    auto modelUnit = ModelFactory::factory.find(modelName);
+    if (modelUnit == ModelFactory::factory.end()) {
+        throw std::runtime_error("Unknown model " + modelName);
+    }
+
+    DetectorParams params = resolver(modelName);
+    if (threshold > 1) {
+        throw std::runtime_error("Threshold must be in (0..1]");
+    }
+    float runtimeThreshold = threshold;
+    uint64_t changes;
+    {
+        std::lock_guard<std::mutex> stateLock(stateMutex);
+        if (runtimeThreshold <= 0) {
+            runtimeThreshold = thresholdOverride;
+        }
+        changes = thresholdChanges;
+    }
+    if (runtimeThreshold > 0) {
+        params.threshold = runtimeThreshold;
+    }
+    if (inputSize > 0) {
+        params.inputSize = inputSize;
+    }
+
+    LoadTiming timing = {0, 0, 0};
+    auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<IModelDnnDetector> loaded = modelUnit->second(modelDir, inCaps, &params);
+    timing.loadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    loaded->SetRoi(params.roi);
+    if (params.tiling) {
+        loaded->SetTiling(params.tileSize, params.tileOverlap);
+    }
+    if (params.refine) {
+        loaded->SetRefinement(params.refineThreshold, params.refineMax);
+    }
+    if (params.motionSensitivity > 0) {
+        loaded->SetMotionGate(params.motionSensitivity, params.motionMaxSkip);
+    }
+
+    if (warmup > 0) {
+        timing.warmUpMs = loaded->WarmUp(warmup);
+    }
+
+    std::shared_ptr<IModelDnnDetector> replaced;
+    {
+        // A threshold set during the load went to the replaced model and is the newest
+        std::lock_guard<std::mutex> stateLock(stateMutex);
+        if (thresholdChanges != changes) {
+            loaded->SetThreshold(thresholdOverride);
+        } else if (threshold > 0) {
+            thresholdOverride = threshold;
+        }
+        replaced = std::atomic_exchange(&active, loaded);
+        activeName = modelName;
+        timing.loads = ++loads;
+    }
+    Retire(std::move(replaced));
+
+    return timing;
+}
+
+// Frames hold the detector only while they are processed, so the last reference goes
+// away shortly; past the wait it is dropped wherever that happens
+void DetectorSlot::Retire(std::shared_ptr<IModelDnnDetector> detector) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (detector && detector.use_count() > 1 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    if (detector.use_count() > 1) {
+        std::cerr << "Replaced model still in use, released by its last frame" << std::endl;
+    }
+}
+
+void DetectorSlot::SetThreshold(float threshold) {
+    std::lock_guard<std::mutex> lock(stateMutex);
+    auto detector = Get();
+    if (!detector) {
+        throw std::runtime_error("No active model");
+    }
+    detector->SetThreshold(threshold);
+    thresholdOverride = threshold;
+    thresholdChanges++;
+}
\ No newline at end of file
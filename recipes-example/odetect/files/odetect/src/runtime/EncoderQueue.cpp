@@ -0,0 +1,84 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "runtime/EncoderQueue.hpp"
+
+#include <sstream>
+#include <stdexcept>
+
+EncoderQueue::Policy EncoderQueue::ParsePolicy(const std::string& name) {
+    if (name == "block") {
+        return Policy::Block;
+    } else if (name == "drop-oldest") {
+        return Policy::DropOldest;
+    } else if (name == "drop-newest") {
+        return Policy::DropNewest;
+    }
+    throw std::runtime_error("Unknown encoder queue policy " + name + ", expected block|drop-oldest|drop-newest");
+}
+
+EncoderQueue::EncoderQueue(GstAppSrc* appsrc, Policy policy, uint64_t maxBytes, unsigned int maxBuffers)
+    : appsrc(GST_APP_SRC(gst_object_ref(appsrc)))
+{
+    GstAppLeakyType leaky = policy == Policy::DropOldest ? GST_APP_LEAKY_TYPE_DOWNSTREAM
+        : policy == Policy::DropNewest ? GST_APP_LEAKY_TYPE_UPSTREAM : GST_APP_LEAKY_TYPE_NONE;
+
+    g_object_set(appsrc,
+        "max-bytes", static_cast<guint64>(maxBytes),
+        "max-buffers", static_cast<guint64>(maxBuffers),
+        "block", policy == Policy::Block,
+        "leaky-type", leaky,
+        NULL);
+}
+
+EncoderQueue::~EncoderQueue() {
+    gst_object_unref(appsrc);
+}
+
+GstFlowReturn EncoderQueue::Push(GstBuffer* buffer) {
+    return gst_app_src_push_buffer(appsrc, buffer);
+}
+
+uint64_t EncoderQueue::Dropped() const {
+    guint64 dropped = 0;
+    g_object_get(appsrc, "dropped", &dropped, NULL);
+    return dropped;
+}
+
+uint64_t EncoderQueue::LevelBytes() const {
+    return gst_app_src_get_current_level_bytes(appsrc);
+}
+
+uint64_t EncoderQueue::LevelBuffers() const {
+    guint64 level = 0;
+    g_object_get(appsrc, "current-level-buffers", &level, NULL);
+    return level;
+}
+
+std::string EncoderQueue::Summary() const {
+    std::ostringstream summary;
+    summary << "encoder_queue_buffers " << LevelBuffers() << " encoder_queue_bytes " << LevelBytes()
+            << " encoder_queue_dropped " << Dropped();
+    return summary.str();
+}
\ No newline at end of file
@@ -0,0 +1,118 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "runtime/FrameLineage.hpp"
+
+#include <gst/rtp/gstrtpbuffer.h>
+
+FrameLineage::FrameLineage()
+    : next(0), captured(0)
+{
+    entries.fill({GST_CLOCK_TIME_NONE, 0});
+}
+
+void FrameLineage::AttachCapture(GstElement *source) {
+    GstPad *pad = gst_element_get_static_pad(source, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, OnCapture, this, NULL);
+    gst_object_unref(pad);
+}
+
+void FrameLineage::AttachEgress(GstElement *payloader) {
+    GstPad *pad = gst_element_get_static_pad(payloader, "src");
+    gst_pad_add_probe(pad, static_cast<GstPadProbeType>(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+        OnEgress, this, NULL);
+    gst_object_unref(pad);
+}
+
+GstPadProbeReturn FrameLineage::OnCapture(GstPad *pad, GstPadProbeInfo *info, gpointer self) {
+    FrameLineage *lineage = static_cast<FrameLineage *>(self);
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER(info);
+
+    std::lock_guard<std::mutex> lock(lineage->mutex);
+    lineage->entries[lineage->next] = {GST_BUFFER_PTS(buffer), lineage->captured++};
+    lineage->next = (lineage->next + 1) % lineage->entries.size();
+    return GST_PAD_PROBE_OK;
+}
+
+GstPadProbeReturn FrameLineage::OnEgress(GstPad *pad, GstPadProbeInfo *info, gpointer self) {
+    FrameLineage *lineage = static_cast<FrameLineage *>(self);
+    GstClockTime baseTime = gst_element_get_base_time(GST_ELEMENT(GST_PAD_PARENT(pad)));
+
+    if (GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+        GstBufferList *list = gst_buffer_list_make_writable(GST_PAD_PROBE_INFO_BUFFER_LIST(info));
+        guint length = gst_buffer_list_length(list);
+        for (guint i = 0; i < length; i++) {
+            lineage->Stamp(gst_buffer_list_get_writable(list, i), baseTime);
+        }
+        GST_PAD_PROBE_INFO_DATA(info) = list;
+    } else {
+        GstBuffer *buffer = gst_buffer_make_writable(GST_PAD_PROBE_INFO_BUFFER(info));
+        lineage->Stamp(buffer, baseTime);
+        GST_PAD_PROBE_INFO_DATA(info) = buffer;
+    }
+    return GST_PAD_PROBE_OK;
+}
+
+void FrameLineage::Stamp(GstBuffer *rtp, GstClockTime baseTime) const {
+    GstClockTime pts = GST_BUFFER_PTS(rtp);
+    if (!GST_CLOCK_TIME_IS_VALID(pts)) {
+        return;
+    }
+
+    GstRTPBuffer rtpBuffer = GST_RTP_BUFFER_INIT;
+    if (!gst_rtp_buffer_map(rtp, GST_MAP_READWRITE, &rtpBuffer)) {
+        return;
+    }
+
+    uint64_t captureTime = baseTime + pts;
+    uint8_t time[8];
+    for (int i = 0; i < 8; i++) {
+        time[i] = static_cast<uint8_t>(captureTime >> (56 - 8 * i));
+    }
+    gst_rtp_buffer_add_extension_onebyte_header(&rtpBuffer, CaptureTimeExtId, time, sizeof(time));
+
+    uint32_t seq;
+    if (Lookup(pts, seq)) {
+        uint8_t seqBytes[4] = {
+            static_cast<uint8_t>(seq >> 24), static_cast<uint8_t>(seq >> 16),
+            static_cast<uint8_t>(seq >> 8), static_cast<uint8_t>(seq),
+        };
+        gst_rtp_buffer_add_extension_onebyte_header(&rtpBuffer, FrameSeqExtId, seqBytes, sizeof(seqBytes));
+    }
+
+    gst_rtp_buffer_unmap(&rtpBuffer);
+}
+
+bool FrameLineage::Lookup(GstClockTime pts, uint32_t& seq) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Newest first, the egress trails the capture by a few frames
+    for (size_t i = 1; i <= entries.size(); i++) {
+        const Entry& entry = entries[(next + entries.size() - i) % entries.size()];
+        if (entry.pts == pts) {
+            seq = entry.seq;
+            return true;
+        }
+    }
+    return false;
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "runtime/FrameScheduler.hpp"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+FrameScheduler::FrameScheduler(double deadlineMs)
+    : deadlineMs(deadlineMs), expectedMs(0), consecutiveDrops(0), admitted(0), reportedDrops(0),
+      lastReport(std::chrono::steady_clock::now())
+{
+    if (deadlineMs < 0) {
+        throw std::runtime_error("Frame deadline must not be negative");
+    }
+    for (auto& counter : dropped) {
+        counter = 0;
+    }
+}
+
+bool FrameScheduler::Admit(double ageMs) {
+    Report();
+
+    if (deadlineMs > 0 && ageMs >= 0) {
+        DropReason reason = DropReason::Count;
+        if (ageMs > deadlineMs) {
+            reason = DropReason::Stale;
+        } else if (ageMs + expectedMs.load(std::memory_order_relaxed) > deadlineMs
+                   && consecutiveDrops < maxConsecutiveDrops) {
+            // Only an estimate, a late frame gets through now and then to refresh it
+            reason = DropReason::Late;
+        }
+
+        if (reason != DropReason::Count) {
+            dropped[static_cast<size_t>(reason)]++;
+            consecutiveDrops++;
+            return false;
+        }
+    }
+
+    consecutiveDrops = 0;
+    admitted++;
+    return true;
+}
+
+void FrameScheduler::Done(double processingMs) {
+    double expected = expectedMs.load(std::memory_order_relaxed);
+    expectedMs.store(expected > 0 ? 0.8 * expected + 0.2 * processingMs : processingMs, std::memory_order_relaxed);
+}
+
+void FrameScheduler::SetDropped(DropReason reason, uint64_t total) {
+    dropped[static_cast<size_t>(reason)] = total;
+}
+
+std::string FrameScheduler::Summary() const {
+    std::ostringstream summary;
+    summary << "admitted " << Admitted() << " stale " << Dropped(DropReason::Stale) << " late " << Dropped(DropReason::Late)
+            << " encoder_queue " << Dropped(DropReason::EncoderQueue);
+    return summary.str();
+}
+
+// A line now and then while frames are being dropped
+void FrameScheduler::Report() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastReport < reportPeriod) {
+        return;
+    }
+    lastReport = now;
+
+    uint64_t drops = 0;
+    for (const auto& counter : dropped) {
+        drops += counter;
+    }
+    if (drops != reportedDrops) {
+        reportedDrops = drops;
+        std::cout << "Frame scheduler: " << Summary() << ", expected processing " << expectedMs.load() << " ms" << std::endl;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,124 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "runtime/PipelinedDetector.hpp"
+#include "utils/AllocTracker.hpp"
+#include "utils/FlightRecorder.hpp"
+#include "utils/Tracer.hpp"
+
+#include <pthread.h>
+
+PipelinedDetector::PipelinedDetector(const JobFactory& newJob, Done done)
+    : done(std::move(done))
+    , idle(stages)
+    , forwardQueue(1)
+    , finishQueue(1)
+{
+    for (size_t i = 0; i < stages; i++) {
+        jobs.push_back(newJob());
+        idle.Push(jobs.back().get());
+    }
+    forwardThread = std::thread(&PipelinedDetector::ForwardLoop, this);
+    finishThread = std::thread(&PipelinedDetector::FinishLoop, this);
+}
+
+PipelinedDetector::~PipelinedDetector() {
+    Stop();
+}
+
+PipelinedDetector::Job* PipelinedDetector::Begin() {
+    Job* job = nullptr;
+    idle.Pop(job);
+    return job;
+}
+
+void PipelinedDetector::Submit(Job* job, std::shared_ptr<const IModelDnnDetector> detector, const OdBuf inBuf, OdBuf outBuf) {
+    job->detector = std::move(detector);
+    job->outBuf = outBuf;
+    job->error.clear();
+    try {
+        job->frame.emplace(job->detector->Prepare(inBuf));
+    } catch (std::exception& e) {
+        job->error = e.what();
+    }
+
+    FlightRecorder::TakeStages(job->stageMs);
+    AllocTracker::FrameHandOff();
+    forwardQueue.Push(job);
+}
+
+void PipelinedDetector::ForwardLoop() {
+    pthread_setname_np(pthread_self(), "od-forward");
+
+    Job* job;
+    while (forwardQueue.Pop(job)) {
+        AllocTracker::FrameBegin();
+        Tracer::SetFrame(job->seq);
+        FlightRecorder::AddStages(job->stageMs);
+        if (job->frame) {
+            try {
+                job->detector->Forward(**job->frame);
+            } catch (std::exception& e) {
+                job->error = e.what();
+            }
+        }
+        FlightRecorder::TakeStages(job->stageMs);
+        AllocTracker::FrameHandOff();
+        finishQueue.Push(job);
+    }
+    finishQueue.Close();
+}
+
+void PipelinedDetector::FinishLoop() {
+    pthread_setname_np(pthread_self(), "od-finish");
+
+    Job* job;
+    while (finishQueue.Pop(job)) {
+        AllocTracker::FrameBegin();
+        Tracer::SetFrame(job->seq);
+        FlightRecorder::AddStages(job->stageMs);
+        if (job->frame && job->error.empty()) {
+            try {
+                job->detector->Finish(**job->frame, job->outBuf);
+            } catch (std::exception& e) {
+                job->error = e.what();
+            }
+        }
+        // The frame goes back to the detector's pool before the detector may go away
+        job->frame.reset();
+        done(*job);
+        job->detector.reset();
+        idle.Push(job);
+    }
+}
+
+void PipelinedDetector::Stop() {
+    forwardQueue.Close();
+    if (forwardThread.joinable()) {
+        forwardThread.join();
+    }
+    if (finishThread.joinable()) {
+        finishThread.join();
+    }
+}
\ No newline at end of file
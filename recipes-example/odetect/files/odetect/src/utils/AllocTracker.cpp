@@ -0,0 +1,269 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "utils/AllocTracker.hpp"
+#include "utils/Stage.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Stage::Count - inside a frame, outside any stage
+constexpr size_t slotCount = static_cast<size_t>(Stage::Count) + 1;
+
+struct Totals {
+    std::array<uint64_t, slotCount> count;
+    std::array<uint64_t, slotCount> bytes;
+};
+
+// Constant initialized, usable from malloc before any constructor has run
+std::array<std::atomic<uint64_t>, slotCount> allocCount;
+std::array<std::atomic<uint64_t>, slotCount> allocBytes;
+
+// Static TLS only, a dynamic TLS block would be allocated by malloc itself
+__thread bool inFrame __attribute__((tls_model("initial-exec"))) = false;
+__thread int currentStage __attribute__((tls_model("initial-exec"))) = static_cast<int>(Stage::Count);
+
+int checkFrames = 0;
+uint64_t frames = 0;
+Totals steadyStart;
+bool finished = false;
+bool passed = false;
+int64_t reportPeriodNs = 0;
+int64_t lastReport = 0;
+
+inline void Count(size_t size) {
+    if (inFrame && AllocTracker::Enabled()) {
+        allocCount[currentStage].fetch_add(1, std::memory_order_relaxed);
+        allocBytes[currentStage].fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+Totals Snapshot() {
+    Totals totals;
+    for (size_t i = 0; i < slotCount; i++) {
+        totals.count[i] = allocCount[i].load(std::memory_order_relaxed);
+        totals.bytes[i] = allocBytes[i].load(std::memory_order_relaxed);
+    }
+    return totals;
+}
+
+const char* SlotName(size_t slot) {
+    return slot < static_cast<size_t>(Stage::Count) ? StageName(static_cast<Stage>(slot)) : "frame";
+}
+
+// Stages running only odetect's own code on reused buffers. The others call into
+// OpenCV (blobFromImage, NMSBoxes), the backends or GStreamer, which allocate on
+// their own terms
+bool Checked(size_t slot) {
+    return slot == static_cast<size_t>(Stage::Copy) || slot == static_cast<size_t>(Stage::Decode)
+        || slot == static_cast<size_t>(Stage::Draw);
+}
+
+} // namespace
+
+#ifdef ODETECT_ALLOC_TRACKING
+// glibc keeps its allocator reachable under these names, everything else forwards to them
+extern "C" {
+void* __libc_malloc(size_t size);
+void __libc_free(void* ptr);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+void* malloc(size_t size) {
+    Count(size);
+    return __libc_malloc(size);
+}
+
+void free(void* ptr) {
+    __libc_free(ptr);
+}
+
+void* calloc(size_t count, size_t size) {
+    Count(count * size);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    Count(size);
+    return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    Count(size);
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    Count(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+    if (!alignment || (alignment & (alignment - 1)) || alignment % sizeof(void*)) {
+        return EINVAL;
+    }
+    Count(size);
+    void* result = __libc_memalign(alignment, size);
+    if (!result) {
+        return ENOMEM;
+    }
+    *ptr = result;
+    return 0;
+}
+}
+#endif
+
+std::atomic<bool> AllocTracker::enabled{false};
+
+bool AllocTracker::Available() {
+#ifdef ODETECT_ALLOC_TRACKING
+    return true;
+#else
+    return false;
+#endif
+}
+
+void AllocTracker::Start(int checkFrames, double reportSeconds) {
+    if (!Available()) {
+        throw std::runtime_error("allocation tracking needs a build with ODETECT_ALLOC_TRACKING");
+    }
+    ::checkFrames = checkFrames;
+    reportPeriodNs = static_cast<int64_t>(reportSeconds * 1e9);
+    lastReport = MonotonicNs();
+    enabled = true;
+}
+
+void AllocTracker::Stop() {
+    if (enabled.exchange(false) && !finished) {
+        std::cout << Report();
+    }
+}
+
+int AllocTracker::EnterStage(Stage stage) {
+    int previous = currentStage;
+    currentStage = static_cast<int>(stage);
+    return previous;
+}
+
+void AllocTracker::LeaveStage(int previous) {
+    currentStage = previous;
+}
+
+void AllocTracker::FrameBegin() {
+    if (Enabled()) {
+        currentStage = static_cast<int>(Stage::Count);
+        inFrame = true;
+    }
+}
+
+void AllocTracker::FrameHandOff() {
+    inFrame = false;
+}
+
+void AllocTracker::FrameDone() {
+    if (!Enabled() || !inFrame) {
+        return;
+    }
+    inFrame = false;
+
+    // Frames come from one streaming thread
+    frames++;
+    if (frames == static_cast<uint64_t>(warmUpFrames)) {
+        steadyStart = Snapshot();
+    }
+
+    if (checkFrames > 0) {
+        if (!finished && frames == static_cast<uint64_t>(warmUpFrames + checkFrames)) {
+            Totals now = Snapshot();
+            passed = true;
+            for (size_t i = 0; i < slotCount; i++) {
+                passed &= !Checked(i) || now.count[i] == steadyStart.count[i];
+            }
+            std::cout << Report();
+            std::cout << "Allocation check " << (passed ? "passed" : "FAILED") << ": " << checkFrames
+                      << " steady state frames" << (passed ? " without allocations" : " allocate")
+                      << " in the checked stages" << std::endl;
+            finished = true;
+        }
+    } else if (reportPeriodNs > 0) {
+        int64_t now = MonotonicNs();
+        if (now - lastReport >= reportPeriodNs) {
+            lastReport = now;
+            std::cout << Report();
+        }
+    }
+}
+
+int AllocTracker::State() {
+    return Enabled() && inFrame ? currentStage : -1;
+}
+
+int AllocTracker::Adopt(int state) {
+    int previous = inFrame ? currentStage : -1;
+    inFrame = state >= 0;
+    if (inFrame) {
+        currentStage = state;
+    }
+    return previous;
+}
+
+bool AllocTracker::Finished() {
+    return finished;
+}
+
+bool AllocTracker::Passed() {
+    return passed;
+}
+
+std::string AllocTracker::Report() {
+    std::ostringstream report;
+    if (frames <= static_cast<uint64_t>(warmUpFrames)) {
+        report << "Allocations: still warming up (" << frames << "/" << warmUpFrames << " frames)\n";
+        return report.str();
+    }
+
+    const Totals now = Snapshot();
+    const double steadyFrames = static_cast<double>(frames - warmUpFrames);
+    report << "Allocations per frame over " << frames - warmUpFrames << " steady state frames:\n";
+    report << std::left << std::setw(12) << "stage" << std::right << std::setw(10) << "count" << std::setw(12) << "bytes"
+           << std::setw(10) << "checked" << "\n";
+    report << std::fixed << std::setprecision(2);
+    for (size_t i = 0; i < slotCount; i++) {
+        uint64_t count = now.count[i] - steadyStart.count[i];
+        if (count) {
+            report << std::left << std::setw(12) << SlotName(i) << std::right << std::setw(10) << count / steadyFrames
+                   << std::setw(12) << (now.bytes[i] - steadyStart.bytes[i]) / steadyFrames
+                   << std::setw(10) << (Checked(i) ? "yes" : "no") << "\n";
+        }
+    }
+    return report.str();
+}
\ No newline at end of file
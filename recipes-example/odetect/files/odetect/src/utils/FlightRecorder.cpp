@@ -0,0 +1,222 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "utils/FlightRecorder.hpp"
+#include "utils/Stage.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+namespace {
+
+constexpr size_t stageCount = static_cast<size_t>(Stage::Count);
+
+struct FrameRecord {
+    uint32_t seq;
+    bool dropped;
+    float ageMs;
+    float processingMs;
+    std::array<float, stageCount> stageMs;
+    uint32_t queueBuffers;
+    uint64_t queueBytes;
+};
+
+// Odd version - being written
+struct Slot {
+    std::atomic<uint32_t> version{0};
+    FrameRecord record;
+};
+
+std::unique_ptr<Slot[]> slots;
+size_t slotCount = 0;
+std::atomic<uint64_t> head{0};
+
+std::string dumpDir;
+double latencyThresholdMs = 0;
+std::atomic<const char*> pendingDump{nullptr};
+int64_t lastLatencyDump = 0;
+const int64_t latencyDumpPeriodNs = 10000000000;
+
+thread_local std::array<float, stageCount> localStageMs{};
+
+// Capture is before admission, in age_ms, and encoding ends after the frame is recorded,
+// so neither has a column of its own
+bool HasColumn(size_t stage) {
+    return stage != static_cast<size_t>(Stage::Capture) && stage != static_cast<size_t>(Stage::Encode);
+}
+
+void Put(const FrameRecord& record) {
+    Slot& slot = slots[head.fetch_add(1, std::memory_order_relaxed) % slotCount];
+    uint32_t version = slot.version.load(std::memory_order_relaxed);
+    slot.version.store(version + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.record = record;
+    slot.version.store(version + 2, std::memory_order_release);
+}
+
+bool Get(const Slot& slot, FrameRecord& record) {
+    uint32_t version = slot.version.load(std::memory_order_acquire);
+    if (version & 1) {
+        return false;
+    }
+    record = slot.record;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return version && slot.version.load(std::memory_order_relaxed) == version;
+}
+
+} // namespace
+
+std::atomic<bool> FlightRecorder::enabled{false};
+
+void FlightRecorder::Start(const std::string& dir, size_t frames, double thresholdMs) {
+    slots.reset(new Slot[frames]);
+    slotCount = frames;
+    dumpDir = dir;
+    latencyThresholdMs = thresholdMs;
+    enabled = frames > 0;
+}
+
+void FlightRecorder::AddStage(Stage stage, int64_t durationNs) {
+    if (Enabled()) {
+        localStageMs[static_cast<size_t>(stage)] += durationNs / 1e6f;
+    }
+}
+
+void FlightRecorder::TakeStages(std::vector<float>& stageMs) {
+    stageMs.assign(localStageMs.begin(), localStageMs.end());
+    localStageMs.fill(0);
+}
+
+void FlightRecorder::AddStages(const std::vector<float>& stageMs) {
+    for (size_t i = 0; i < stageMs.size() && i < stageCount; i++) {
+        localStageMs[i] += stageMs[i];
+    }
+}
+
+void FlightRecorder::TakeStages(float* stageMs) {
+    std::copy(localStageMs.begin(), localStageMs.end(), stageMs);
+    localStageMs.fill(0);
+}
+
+void FlightRecorder::AddStages(const float* stageMs) {
+    for (size_t i = 0; i < stageCount; i++) {
+        localStageMs[i] += stageMs[i];
+    }
+}
+
+void FlightRecorder::FrameDone(uint32_t seq, double ageMs, double processingMs, uint64_t queueBuffers, uint64_t queueBytes) {
+    if (!Enabled()) {
+        return;
+    }
+
+    FrameRecord record = {seq, false, static_cast<float>(ageMs), static_cast<float>(processingMs), localStageMs,
+        static_cast<uint32_t>(queueBuffers), queueBytes};
+    localStageMs.fill(0);
+    Put(record);
+
+    if (latencyThresholdMs > 0 && ageMs >= 0 && ageMs + processingMs > latencyThresholdMs) {
+        // One dump covers the whole ring, the next stall within the period is in it as well
+        int64_t now = MonotonicNs();
+        if (!lastLatencyDump || now - lastLatencyDump > latencyDumpPeriodNs) {
+            lastLatencyDump = now;
+            RequestDump("latency");
+        }
+    }
+}
+
+void FlightRecorder::FrameDropped(uint32_t seq, double ageMs) {
+    if (!Enabled()) {
+        return;
+    }
+
+    FrameRecord record = {seq, true, static_cast<float>(ageMs), 0, {}, 0, 0};
+    Put(record);
+}
+
+void FlightRecorder::RequestDump(const char* reason) {
+    const char* none = nullptr;
+    pendingDump.compare_exchange_strong(none, reason);
+}
+
+void FlightRecorder::Poll() {
+    const char* reason = pendingDump.exchange(nullptr);
+    if (reason) {
+        Dump(reason);
+    }
+}
+
+std::string FlightRecorder::Dump(const char* reason) {
+    if (!Enabled()) {
+        return "";
+    }
+
+    time_t now = time(nullptr);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+    std::string path = dumpDir + "/odetect-flight-" + stamp + "-" + reason + ".csv";
+
+    std::ofstream file(path);
+    if (!file) {
+        std::cerr << "Could not write the flight recorder dump to " << path << std::endl;
+        return "";
+    }
+
+    file << "# reason " << reason << ", latency threshold " << latencyThresholdMs << " ms, oldest frame first\n";
+    file << "seq,status,age_ms,processing_ms,latency_ms";
+    for (size_t i = 0; i < stageCount; i++) {
+        if (HasColumn(i)) {
+            file << "," << StageName(static_cast<Stage>(i)) << "_ms";
+        }
+    }
+    file << ",encoder_queue_buffers,encoder_queue_bytes\n";
+    file << std::fixed << std::setprecision(2);
+
+    const uint64_t end = head.load(std::memory_order_acquire);
+    const uint64_t begin = end > slotCount ? end - slotCount : 0;
+    size_t written = 0;
+    for (uint64_t i = begin; i < end; i++) {
+        FrameRecord record;
+        if (!Get(slots[i % slotCount], record)) {
+            continue;
+        }
+        file << record.seq << "," << (record.dropped ? "dropped" : "done") << "," << record.ageMs << ","
+             << record.processingMs << "," << (record.ageMs >= 0 ? record.ageMs + record.processingMs : -1);
+        for (size_t stage = 0; stage < stageCount; stage++) {
+            if (HasColumn(stage)) {
+                file << "," << record.stageMs[stage];
+            }
+        }
+        file << "," << record.queueBuffers << "," << record.queueBytes << "\n";
+        written++;
+    }
+
+    std::cerr << "Flight recorder (" << reason << "): " << written << " frames written to " << path << std::endl;
+    return path;
+}
\ No newline at end of file
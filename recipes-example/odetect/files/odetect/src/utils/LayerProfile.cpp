@@ -0,0 +1,116 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "utils/LayerProfile.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+LayerProfile::LayerProfile(const std::string& title, int passes)
+    : title(title), passes(passes), seen(0), done(0), forwardMs(0)
+{
+}
+
+void LayerProfile::Add(const std::string& name, const std::string& type, double ms) {
+    if (Collecting()) {
+        pending.push_back({name, type, ms});
+    }
+}
+
+void LayerProfile::PassDone(double forwardMs) {
+    if (!Collecting()) {
+        return;
+    }
+    if (++seen <= skipPasses) {
+        pending.clear();
+        return;
+    }
+
+    for (const auto& layer : pending) {
+        auto it = index.find(layer.name);
+        if (it == index.end()) {
+            index[layer.name] = layers.size();
+            layers.push_back(layer);
+        } else {
+            layers[it->second].ms += layer.ms;
+        }
+    }
+    pending.clear();
+    this->forwardMs += forwardMs;
+
+    if (++done == passes) {
+        std::cout << Report();
+    }
+}
+
+std::string LayerProfile::Report(size_t top) const {
+    std::ostringstream report;
+    report << std::fixed << std::setprecision(3);
+    if (!done) {
+        report << "Layer profile of " << title << ": no forward passes yet\n";
+        return report.str();
+    }
+
+    const double passMs = forwardMs / done;
+    double layersMs = 0;
+    std::map<std::string, std::pair<double, int>> types;
+    for (const auto& layer : layers) {
+        layersMs += layer.ms;
+        types[layer.type].first += layer.ms;
+        types[layer.type].second++;
+    }
+
+    report << "Layer profile of " << title << ", " << done << " forward passes: " << passMs << " ms per pass, "
+           << layersMs / done << " ms in " << layers.size() << " layers\n";
+
+    std::vector<const Layer*> sorted;
+    for (const auto& layer : layers) {
+        sorted.push_back(&layer);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Layer* a, const Layer* b) { return a->ms > b->ms; });
+
+    report << std::left << std::setw(40) << "  layer" << std::setw(20) << "type" << std::right << std::setw(10) << "ms"
+           << std::setw(9) << "share" << "\n";
+    for (size_t i = 0; i < sorted.size() && i < top; i++) {
+        const Layer& layer = *sorted[i];
+        report << std::left << "  " << std::setw(38) << layer.name.substr(0, 37) << std::setw(20) << layer.type.substr(0, 19)
+               << std::right << std::setw(10) << layer.ms / done
+               << std::setprecision(1) << std::setw(8) << (passMs > 0 ? 100 * layer.ms / done / passMs : 0) << "%"
+               << std::setprecision(3) << "\n";
+    }
+
+    std::vector<std::pair<std::string, std::pair<double, int>>> sortedTypes(types.begin(), types.end());
+    std::sort(sortedTypes.begin(), sortedTypes.end(), [](const auto& a, const auto& b) { return a.second.first > b.second.first; });
+    report << std::left << std::setw(40) << "  layer type" << std::setw(20) << "layers" << std::right << std::setw(10) << "ms"
+           << std::setw(9) << "share" << "\n";
+    for (const auto& type : sortedTypes) {
+        report << std::left << "  " << std::setw(38) << type.first.substr(0, 37) << std::setw(20) << type.second.second
+               << std::right << std::setw(10) << type.second.first / done
+               << std::setprecision(1) << std::setw(8) << (passMs > 0 ? 100 * type.second.first / done / passMs : 0) << "%"
+               << std::setprecision(3) << "\n";
+    }
+    return report.str();
+}
\ No newline at end of file
@@ -0,0 +1,79 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "utils/ModelCache.hpp"
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+
+ModelCache::ModelCache(const std::string& dir)
+    : dir(dir), usable(false)
+{
+    if (dir.empty()) {
+        return;
+    }
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cerr << "Model cache disabled, can't create " << dir << std::endl;
+        return;
+    }
+    if (access(dir.c_str(), W_OK) != 0) {
+        std::cerr << "Model cache disabled, " << dir << " is not writable" << std::endl;
+        return;
+    }
+    usable = true;
+}
+
+uint64_t ModelCache::Hash(const char* data, size_t size) {
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+std::string ModelCache::EntryPath(const MappedFile& model, const BackendParams& params, const std::string& tag, const std::string& extension) const {
+    char name[256];
+    snprintf(name, sizeof(name), "%016llx-%s-%s-%dx%d-%s-v%d%s",
+        static_cast<unsigned long long>(Hash(model.Data(), model.Size())),
+        params.name.c_str(), PrecisionToString(params.precision),
+        params.inputSize.width, params.inputSize.height, tag.c_str(), Version, extension.c_str());
+    return dir + "/" + name;
+}
+
+std::string ModelCache::StagingPath(const std::string& entryPath) const {
+    return entryPath + ".tmp" + std::to_string(getpid());
+}
+
+bool ModelCache::Publish(const std::string& stagingPath, const std::string& entryPath) const {
+    if (rename(stagingPath.c_str(), entryPath.c_str()) != 0) {
+        unlink(stagingPath.c_str());
+        return false;
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "utils/MotionGate.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <linux/videodev2.h>
+
+MotionGate::MotionGate(const ODCaps& caps, float sensitivity, int maxSkip)
+    : caps(caps), sensitivity(sensitivity), maxSkip(maxSkip), skipped(0)
+{
+    if (caps.pformat != V4L2_PIX_FMT_YUYV && caps.pformat != V4L2_PIX_FMT_BGR24) {
+        throw std::runtime_error("Motion gate supports YUYV and BGR input only");
+    }
+    if (sensitivity <= 0 || sensitivity > 1 || maxSkip < 0) {
+        throw std::runtime_error("Motion sensitivity must be in (0..1] and max skip >= 0");
+    }
+
+    // About 64 cells across, whatever the resolution
+    cellSize = std::max(8, caps.width / 64);
+    gridWidth = std::max(1, caps.width / cellSize);
+    gridHeight = std::max(1, caps.height / cellSize);
+    current.resize(gridWidth * gridHeight);
+}
+
+int MotionGate::Luma(const uint8_t* frame, int x, int y) const {
+    size_t pixel = static_cast<size_t>(y) * caps.width + x;
+    if (caps.pformat == V4L2_PIX_FMT_YUYV) {
+        // Y0 U Y1 V, luma is every even byte
+        return frame[pixel * 2];
+    }
+    const uint8_t* bgr = frame + pixel * 3;
+    return (bgr[0] + 2 * bgr[1] + bgr[2]) >> 2;
+}
+
+void MotionGate::Sample(const uint8_t* frame, std::vector<uint16_t>& cells) const {
+    for (int cy = 0; cy < gridHeight; cy++) {
+        for (int cx = 0; cx < gridWidth; cx++) {
+            int sum = 0;
+            int count = 0;
+            for (int y = cy * cellSize; y < (cy + 1) * cellSize; y += sampleStep) {
+                for (int x = cx * cellSize; x < (cx + 1) * cellSize; x += sampleStep) {
+                    sum += Luma(frame, x, y);
+                    count++;
+                }
+            }
+            cells[cy * gridWidth + cx] = sum / count;
+        }
+    }
+}
+
+bool MotionGate::Check(const uint8_t* frame, bool activeDetections) {
+    Sample(frame, current);
+
+    bool infer = reference.empty() || activeDetections || skipped >= maxSkip;
+    if (!infer) {
+        int changed = 0;
+        for (size_t i = 0; i < current.size(); i++) {
+            if (std::abs(current[i] - reference[i]) > cellThreshold) {
+                changed++;
+            }
+        }
+        infer = changed >= std::max(1, static_cast<int>(sensitivity * current.size()));
+    }
+
+    if (infer) {
+        reference.swap(current);
+        current.resize(reference.size());
+        skipped = 0;
+    } else {
+        skipped++;
+    }
+    return infer;
+}
\ No newline at end of file
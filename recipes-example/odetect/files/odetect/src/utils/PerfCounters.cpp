@@ -0,0 +1,246 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "utils/PerfCounters.hpp"
+#include "utils/Stage.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t stageCount = static_cast<size_t>(Stage::Count);
+
+struct StageTotals {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> wallNs{0};
+    std::atomic<uint64_t> cpuNs{0};
+    std::array<std::atomic<uint64_t>, PerfCounters::CounterCount> counters{};
+};
+
+std::array<StageTotals, stageCount> totals;
+std::array<std::atomic<bool>, PerfCounters::CounterCount> counterSeen{};
+std::atomic<uint64_t> frames{0};
+
+int64_t reportPeriodNs = 0;
+int64_t lastReport = 0;
+std::once_flag unavailableReported;
+
+const uint64_t counterConfigs[PerfCounters::CounterCount] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES,
+};
+
+// Counter group of one thread, members that couldn't be opened are left out
+class ThreadCounters {
+private:
+    int leader = -1;
+    std::array<int, PerfCounters::CounterCount> fds;
+    std::array<int, PerfCounters::CounterCount> slots;
+    int opened = 0;
+
+    static int Open(uint64_t config, int groupFd) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = config;
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.disabled = groupFd < 0;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+    }
+
+public:
+    ThreadCounters() {
+        fds.fill(-1);
+        slots.fill(-1);
+        int error = 0;
+        for (int i = 0; i < PerfCounters::CounterCount; i++) {
+            fds[i] = Open(counterConfigs[i], leader);
+            if (fds[i] < 0) {
+                error = errno;
+                continue;
+            }
+            if (leader < 0) {
+                leader = fds[i];
+            }
+            slots[i] = opened++;
+            counterSeen[i] = true;
+        }
+
+        if (leader >= 0) {
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+        if (error) {
+            bool some = opened > 0;
+            std::call_once(unavailableReported, [error, some]() {
+                std::cerr << "Perf counters: " << (some ? "some hardware counters are" : "hardware counters are")
+                          << " unavailable (" << strerror(error) << "), check /proc/sys/kernel/perf_event_paranoid" << std::endl;
+            });
+        }
+    }
+
+    ~ThreadCounters() {
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    void Read(uint64_t* values) const {
+        // nr, then one value per member in the order they were opened
+        uint64_t buffer[1 + PerfCounters::CounterCount] = {};
+        if (leader < 0 || read(leader, buffer, sizeof(buffer)) <= 0) {
+            return;
+        }
+        for (int i = 0; i < PerfCounters::CounterCount; i++) {
+            if (slots[i] >= 0) {
+                values[i] = buffer[1 + slots[i]];
+            }
+        }
+    }
+};
+
+thread_local std::unique_ptr<ThreadCounters> localCounters;
+
+std::string Scaled(double value) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    if (value >= 1e6) {
+        out << value / 1e6 << "M";
+    } else if (value >= 1e3) {
+        out << value / 1e3 << "k";
+    } else {
+        out << value;
+    }
+    return out.str();
+}
+
+} // namespace
+
+std::atomic<bool> PerfCounters::enabled{false};
+
+void PerfCounters::Start(double reportSeconds) {
+    reportPeriodNs = static_cast<int64_t>(reportSeconds * 1e9);
+    lastReport = MonotonicNs();
+    enabled = true;
+}
+
+void PerfCounters::Stop() {
+    if (enabled.exchange(false)) {
+        std::cout << Report();
+    }
+}
+
+void PerfCounters::Read(PerfSample& sample) {
+    memset(&sample, 0, sizeof(sample));
+    if (!localCounters) {
+        localCounters = std::make_unique<ThreadCounters>();
+    }
+    localCounters->Read(sample.values);
+
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    sample.cpuNs = static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+void PerfCounters::Add(Stage stage, const PerfSample& begin, const PerfSample& end, int64_t wallNs) {
+    StageTotals& stageTotals = totals[static_cast<size_t>(stage)];
+    stageTotals.calls.fetch_add(1, std::memory_order_relaxed);
+    stageTotals.wallNs.fetch_add(wallNs, std::memory_order_relaxed);
+    stageTotals.cpuNs.fetch_add(end.cpuNs - begin.cpuNs, std::memory_order_relaxed);
+    for (int i = 0; i < CounterCount; i++) {
+        stageTotals.counters[i].fetch_add(end.values[i] - begin.values[i], std::memory_order_relaxed);
+    }
+}
+
+void PerfCounters::FrameDone() {
+    if (!Enabled()) {
+        return;
+    }
+
+    frames++;
+    if (reportPeriodNs > 0) {
+        int64_t now = MonotonicNs();
+        if (now - lastReport >= reportPeriodNs) {
+            lastReport = now;
+            std::cout << Report();
+        }
+    }
+}
+
+std::string PerfCounters::Report() {
+    const double frameCount = frames.load();
+    std::ostringstream report;
+    report << "Perf counters over " << frames.load() << " frames, per frame:\n";
+    if (!frameCount) {
+        return report.str();
+    }
+
+    report << std::left << std::setw(12) << "stage" << std::right << std::setw(8) << "calls" << std::setw(10) << "wall ms"
+           << std::setw(10) << "cpu ms" << std::setw(10) << "cycles" << std::setw(10) << "instr" << std::setw(7) << "IPC"
+           << std::setw(12) << "cache-miss" << std::setw(13) << "branch-miss" << "\n";
+    report << std::fixed;
+    for (size_t i = 0; i < stageCount; i++) {
+        const StageTotals& stageTotals = totals[i];
+        if (!stageTotals.calls) {
+            continue;
+        }
+
+        auto counter = [&](Counter id) {
+            return counterSeen[id] ? Scaled(stageTotals.counters[id] / frameCount) : std::string("n/a");
+        };
+        std::string ipc = "n/a";
+        if (counterSeen[Cycles] && counterSeen[Instructions] && stageTotals.counters[Cycles]) {
+            std::ostringstream value;
+            value << std::fixed << std::setprecision(2)
+                  << static_cast<double>(stageTotals.counters[Instructions]) / stageTotals.counters[Cycles];
+            ipc = value.str();
+        }
+
+        report << std::left << std::setw(12) << StageName(static_cast<Stage>(i)) << std::right
+               << std::setprecision(2) << std::setw(8) << stageTotals.calls / frameCount
+               << std::setw(10) << stageTotals.wallNs / frameCount / 1e6
+               << std::setw(10) << stageTotals.cpuNs / frameCount / 1e6
+               << std::setw(10) << counter(Cycles) << std::setw(10) << counter(Instructions) << std::setw(7) << ipc
+               << std::setw(12) << counter(CacheMisses) << std::setw(13) << counter(BranchMisses) << "\n";
+    }
+    return report.str();
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "utils/PrecisionGuard.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+PrecisionGuard::PrecisionGuard(const std::string& path)
+    : path(path)
+{
+}
+
+bool PrecisionGuard::IsAccepted(const std::string& model, const std::string& backend, const std::string& precision, float* recall) const {
+    std::ifstream file(path);
+    std::string line;
+
+    while (std::getline(file, line)) {
+        std::istringstream ss(line);
+        std::string m, b, p, verdict;
+        float r;
+        if (ss >> m >> b >> p >> r >> verdict && m == model && b == backend && p == precision) {
+            if (recall) {
+                *recall = r;
+            }
+            return verdict == "accepted";
+        }
+    }
+
+    return false;
+}
+
+void PrecisionGuard::Record(const std::string& model, const std::string& backend, const std::string& precision, float recall, bool accepted) const {
+    std::vector<std::string> lines;
+    {
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            std::istringstream ss(line);
+            std::string m, b, p;
+            if (ss >> m >> b >> p && m == model && b == backend && p == precision) {
+                continue;
+            }
+            lines.push_back(line);
+        }
+    }
+
+    std::ostringstream entry;
+    entry << model << " " << backend << " " << precision << " " << recall << " " << (accepted ? "accepted" : "refused");
+    lines.push_back(entry.str());
+
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::trunc);
+        for (const auto& line : lines) {
+            file << line << "\n";
+        }
+        if (!file) {
+            throw std::runtime_error("Can't write precision guard " + tmpPath);
+        }
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        throw std::runtime_error("Can't update precision guard " + path);
+    }
+}
\ No newline at end of file
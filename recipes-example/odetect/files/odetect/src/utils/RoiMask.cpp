@@ -0,0 +1,117 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "utils/RoiMask.hpp"
+
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+RoiMask::RoiMask(const std::string& spec, const cv::Size& specSize, const cv::Size& frameSize)
+    : mask(frameSize, CV_8U, cv::Scalar(0))
+{
+    const double sx = static_cast<double>(frameSize.width) / specSize.width;
+    const double sy = static_cast<double>(frameSize.height) / specSize.height;
+    const cv::Rect frame(cv::Point(0, 0), frameSize);
+
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ';')) {
+        if (item.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        std::vector<cv::Point> zone = ParseZone(item);
+        for (auto& point : zone) {
+            point = cv::Point(cvRound(point.x * sx), cvRound(point.y * sy));
+        }
+        cv::Rect zoneBounds = cv::boundingRect(zone) & frame;
+        if (zoneBounds.empty()) {
+            throw std::runtime_error("ROI zone is outside of the frame: " + item);
+        }
+        bounds = bounds.empty() ? zoneBounds : (bounds | zoneBounds);
+        zones.push_back(std::move(zone));
+    }
+
+    if (zones.empty()) {
+        throw std::runtime_error("ROI has no zones");
+    }
+
+    cv::fillPoly(mask, zones, cv::Scalar(255));
+}
+
+std::vector<cv::Point> RoiMask::ParseZone(const std::string& zone) {
+    std::vector<int> values;
+    std::stringstream ss(zone);
+    std::string value;
+    while (std::getline(ss, value, ',')) {
+        try {
+            values.push_back(std::stoi(value));
+        } catch (std::exception&) {
+            throw std::runtime_error("Incorrect ROI zone: " + zone);
+        }
+    }
+
+    if (values.size() == 4) {
+        if (values[2] <= 0 || values[3] <= 0) {
+            throw std::runtime_error("Incorrect ROI rectangle: " + zone);
+        }
+        int x = values[0], y = values[1], w = values[2], h = values[3];
+        return {{x, y}, {x + w, y}, {x + w, y + h}, {x, y + h}};
+    }
+
+    if (values.size() < 6 || values.size() % 2) {
+        throw std::runtime_error("ROI zone must be x,y,w,h or at least 3 x,y points: " + zone);
+    }
+    std::vector<cv::Point> polygon;
+    for (size_t i = 0; i < values.size(); i += 2) {
+        polygon.emplace_back(values[i], values[i + 1]);
+    }
+    return polygon;
+}
+
+std::string RoiMask::ReadSpec(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Can't open ROI file " + path);
+    }
+
+    std::string spec;
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") != std::string::npos) {
+            spec += line + ";";
+        }
+    }
+    return spec;
+}
+
+bool RoiMask::Contains(const cv::Rect& box) const {
+    cv::Point center(box.x + box.width / 2, box.y + box.height / 2);
+    center.x = std::min(std::max(center.x, 0), mask.cols - 1);
+    center.y = std::min(std::max(center.y, 0), mask.rows - 1);
+    return mask.at<uint8_t>(center) != 0;
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "utils/Stage.hpp"
+
+const char* StageName(Stage stage) {
+    switch (stage) {
+        case Stage::Capture:
+            return "capture";
+        case Stage::Copy:
+            return "copy";
+        case Stage::Preprocess:
+            return "preprocess";
+        case Stage::Forward:
+            return "forward";
+        case Stage::Decode:
+            return "decode";
+        case Stage::Nms:
+            return "nms";
+        case Stage::Draw:
+            return "draw";
+        case Stage::Push:
+            return "push";
+        case Stage::Encode:
+            return "encode";
+        default:
+            return "unknown";
+    }
+}
+
+FrameContext::FrameContext()
+    : owner(std::this_thread::get_id()), traceFrame(Tracer::Frame()), allocState(AllocTracker::State()), stageMs{}
+{
+}
+
+FrameContext::~FrameContext() {
+    std::lock_guard<std::mutex> lock(mutex);
+    FlightRecorder::AddStages(stageMs.data());
+}
+
+FrameContext::Join::Join(FrameContext& context)
+    : context(context), foreign(std::this_thread::get_id() != context.owner), traceFrame(0), allocState(-1), stageMs{}
+{
+    if (!foreign) {
+        return;
+    }
+    traceFrame = Tracer::Frame();
+    Tracer::SetFrame(context.traceFrame);
+    FlightRecorder::TakeStages(stageMs.data());
+    allocState = AllocTracker::Adopt(context.allocState);
+}
+
+FrameContext::Join::~Join() {
+    if (!foreign) {
+        return;
+    }
+    AllocTracker::Adopt(allocState);
+    Tracer::SetFrame(traceFrame);
+    StageTimes joined;
+    FlightRecorder::TakeStages(joined.data());
+    FlightRecorder::AddStages(stageMs.data());
+
+    std::lock_guard<std::mutex> lock(context.mutex);
+    for (size_t i = 0; i < joined.size(); i++) {
+        context.stageMs[i] += joined[i];
+    }
+}
\ No newline at end of file
@@ -0,0 +1,292 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "utils/TaskExecutor.hpp"
+
+#include <opencv2/core/parallel/parallel_backend.hpp>
+
+#include <algorithm>
+#include <exception>
+#include <string>
+#include <pthread.h>
+
+namespace {
+
+thread_local const TaskExecutor* workerPool = nullptr;
+thread_local int workerIndex = -1;
+
+// OpenCV's parallel_for_ on the shared pool. Looks the pool up per call, so that loops
+// after TaskExecutor::Stop() run serially instead of on a gone pool.
+class ExecutorParallelBackend : public cv::parallel::ParallelForAPI {
+public:
+    void parallel_for(int tasks, FN_parallel_for_body_cb_t body, void* data) override {
+        TaskExecutor* executor = TaskExecutor::Shared();
+        if (!executor) {
+            body(0, tasks, data);
+            return;
+        }
+        executor->ParallelFor(tasks, 0, [body, data](int begin, int end) {
+            body(begin, end, data);
+        });
+    }
+
+    int getThreadNum() const override {
+        TaskExecutor* executor = TaskExecutor::Shared();
+        return executor ? executor->WorkerIndex() + 1 : 0;
+    }
+
+    int getNumThreads() const override {
+        TaskExecutor* executor = TaskExecutor::Shared();
+        return executor ? executor->Threads() + 1 : 1;
+    }
+
+    // The pool is sized once by TaskExecutor::Start()
+    int setNumThreads(int) override {
+        return getNumThreads();
+    }
+
+    const char* getName() const override {
+        return "odetect";
+    }
+};
+
+} // namespace
+
+std::unique_ptr<TaskExecutor> TaskExecutor::shared;
+
+struct TaskExecutor::Loop {
+    Body body;
+    const void* context;
+    int count;
+    int chunks;
+    std::atomic<int> left;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+};
+
+bool TaskExecutor::Deque::PushBack(const Task& task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tail - head == capacity) {
+        return false;
+    }
+    tasks[tail++ % capacity] = task;
+    return true;
+}
+
+bool TaskExecutor::Deque::PopBack(Task& task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tail == head) {
+        return false;
+    }
+    task = tasks[--tail % capacity];
+    return true;
+}
+
+bool TaskExecutor::Deque::PopFront(Task& task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (tail == head) {
+        return false;
+    }
+    task = tasks[head++ % capacity];
+    return true;
+}
+
+bool TaskExecutor::Deque::Take(const void* loop, Task& task) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = tail; i-- > head;) {
+        if (tasks[i % capacity].loop != loop) {
+            continue;
+        }
+        task = tasks[i % capacity];
+        for (size_t next = i + 1; next < tail; next++) {
+            tasks[(next - 1) % capacity] = tasks[next % capacity];
+        }
+        tail--;
+        return true;
+    }
+    return false;
+}
+
+TaskExecutor::TaskExecutor(int threads)
+    : queued(0), sleeping(0), stopping(false)
+{
+    if (threads <= 0) {
+        threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+    }
+    threadCount = threads;
+    for (int i = 0; i <= threads; i++) {
+        deques.push_back(std::make_unique<Deque>());
+    }
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(&TaskExecutor::WorkerLoop, this, i);
+    }
+}
+
+TaskExecutor::~TaskExecutor() {
+    stopping.store(true);
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_all();
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+int TaskExecutor::WorkerIndex() const {
+    return workerPool == this ? workerIndex : -1;
+}
+
+void TaskExecutor::WorkerLoop(int index) {
+    workerPool = this;
+    workerIndex = index;
+    std::string name = "od-exec-" + std::to_string(index);
+    pthread_setname_np(pthread_self(), name.c_str());
+
+    while (!stopping.load()) {
+        if (RunOne()) {
+            continue;
+        }
+        // Pairs with the queued increment in Push: either it sees this sleeper or the
+        // predicate sees the task
+        sleeping.fetch_add(1);
+        {
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this]() { return stopping.load() || queued.load() > 0; });
+        }
+        sleeping.fetch_sub(1);
+    }
+}
+
+TaskExecutor::Deque& TaskExecutor::Local() {
+    int self = WorkerIndex();
+    return self >= 0 ? *deques[self] : *deques.back();
+}
+
+bool TaskExecutor::Push(const Task& task) {
+    if (!Local().PushBack(task)) {
+        return false;
+    }
+    queued.fetch_add(1);
+    if (sleeping.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_one();
+    }
+    return true;
+}
+
+// Own tasks newest first while they are still in cache, then the oldest ones of others
+bool TaskExecutor::RunOne() {
+    int self = WorkerIndex();
+    Task task;
+    bool found = self >= 0 && deques[self]->PopBack(task);
+    if (!found) {
+        found = deques.back()->PopFront(task);
+    }
+    int victims = Threads();
+    for (int i = 1; !found && i <= victims; i++) {
+        int victim = (std::max(self, 0) + i) % victims;
+        found = victim != self && deques[victim]->PopFront(task);
+    }
+    if (!found) {
+        return false;
+    }
+    queued.fetch_sub(1);
+    task.run(task.loop, task.chunk);
+    return true;
+}
+
+void TaskExecutor::RunChunk(void* loopPtr, int chunk) {
+    Loop& loop = *static_cast<Loop*>(loopPtr);
+    int begin = static_cast<int>(static_cast<int64_t>(loop.count) * chunk / loop.chunks);
+    int end = static_cast<int>(static_cast<int64_t>(loop.count) * (chunk + 1) / loop.chunks);
+    std::exception_ptr error;
+    try {
+        loop.body(loop.context, begin, end);
+    } catch (...) {
+        error = std::current_exception();
+    }
+
+    // Under the mutex, the waiter returns and drops the loop as soon as left hits 0
+    std::lock_guard<std::mutex> lock(loop.mutex);
+    if (error && !loop.error) {
+        loop.error = error;
+    }
+    if (loop.left.fetch_sub(1) == 1) {
+        loop.done.notify_all();
+    }
+}
+
+void TaskExecutor::ParallelFor(int count, int chunks, Body body, const void* context) {
+    if (count <= 0) {
+        return;
+    }
+    if (chunks <= 0) {
+        chunks = Threads() + 1;
+    }
+    chunks = std::min(chunks, count);
+    if (chunks == 1) {
+        body(context, 0, count);
+        return;
+    }
+
+    Loop loop;
+    loop.body = body;
+    loop.context = context;
+    loop.count = count;
+    loop.chunks = chunks;
+    loop.left.store(chunks);
+
+    // The caller takes the first chunk and pops the next ones back unless stolen
+    for (int chunk = chunks - 1; chunk > 0; chunk--) {
+        if (!Push({&TaskExecutor::RunChunk, &loop, chunk})) {
+            RunChunk(&loop, chunk);
+        }
+    }
+    RunChunk(&loop, 0);
+
+    // The chunks nobody stole yet, then waits for the stolen ones. They are running
+    // already, no chunk of this loop can be queued again
+    Deque& deque = Local();
+    Task task;
+    while (deque.Take(&loop, task)) {
+        queued.fetch_sub(1);
+        task.run(task.loop, task.chunk);
+    }
+    std::unique_lock<std::mutex> lock(loop.mutex);
+    loop.done.wait(lock, [&]() { return loop.left.load() == 0; });
+    if (loop.error) {
+        std::rethrow_exception(loop.error);
+    }
+}
+
+void TaskExecutor::Start(int threads) {
+    shared = std::make_unique<TaskExecutor>(threads);
+    cv::parallel::setParallelForBackend(std::make_shared<ExecutorParallelBackend>(), false);
+}
+
+void TaskExecutor::Stop() {
+    shared.reset();
+}
\ No newline at end of file
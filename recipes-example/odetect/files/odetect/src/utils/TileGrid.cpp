@@ -0,0 +1,116 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "utils/TileGrid.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+TileGrid::TileGrid(const cv::Size& area, const cv::Size& tileSize, float overlap)
+    : area(area)
+{
+    if (tileSize.width <= 0 || tileSize.height <= 0 || overlap < 0 || overlap >= 1) {
+        throw std::runtime_error("Incorrect tile size or overlap");
+    }
+
+    const int width = std::min(tileSize.width, area.width);
+    const int height = std::min(tileSize.height, area.height);
+    for (int y : Positions(area.height, height, overlap)) {
+        for (int x : Positions(area.width, width, overlap)) {
+            tiles.emplace_back(x, y, width, height);
+        }
+    }
+}
+
+std::vector<int> TileGrid::Positions(int length, int tile, float overlap) {
+    if (length <= tile) {
+        return {0};
+    }
+
+    int step = std::max(1, static_cast<int>(tile * (1 - overlap)));
+    int count = (length - tile + step - 1) / step + 1;
+    std::vector<int> positions(count);
+    for (int i = 0; i < count; i++) {
+        positions[i] = static_cast<int>(static_cast<int64_t>(i) * (length - tile) / (count - 1));
+    }
+    return positions;
+}
+
+// A box touching a tile edge inside the area is likely a part of a bigger object
+bool TileGrid::IsCut(const cv::Rect& box, const cv::Rect& tile) const {
+    return (tile.x > 0 && box.x <= tile.x + seamMargin)
+        || (tile.y > 0 && box.y <= tile.y + seamMargin)
+        || (tile.br().x < area.width && box.br().x >= tile.br().x - seamMargin)
+        || (tile.br().y < area.height && box.br().y >= tile.br().y - seamMargin);
+}
+
+void TileGrid::Merge(std::vector<std::vector<ODDetection>>& detections, std::vector<ODDetection>& merged) const {
+    struct Candidate {
+        ODDetection* detection;
+        bool cut;
+        bool suppressed;
+    };
+
+    std::vector<Candidate> candidates;
+    for (size_t i = 0; i < detections.size(); i++) {
+        for (auto& det : detections[i]) {
+            bool cut = i < tiles.size() && IsCut(det.box, tiles[i]);
+            candidates.push_back({&det, cut, false});
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.detection->confidence > b.detection->confidence;
+    });
+
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (candidates[i].suppressed) {
+            continue;
+        }
+        ODDetection kept = std::move(*candidates[i].detection);
+
+        for (size_t j = i + 1; j < candidates.size(); j++) {
+            Candidate& other = candidates[j];
+            if (other.suppressed) {
+                continue;
+            }
+            const cv::Rect& box = other.detection->box;
+            float inter = (kept.box & box).area();
+            if (inter <= 0) {
+                continue;
+            }
+
+            float iou = inter / (kept.box.area() + box.area() - inter);
+            float covered = inter / std::min(kept.box.area(), box.area());
+            if (iou > iouThreshold) {
+                other.suppressed = true;
+            } else if ((candidates[i].cut || other.cut) && covered > seamOverlap) {
+                // Both are parts of the same object split by a seam
+                kept.box |= box;
+                other.suppressed = true;
+            }
+        }
+
+        merged.push_back(std::move(kept));
+    }
+}
\ No newline at end of file
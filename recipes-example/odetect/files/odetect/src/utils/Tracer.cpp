@@ -0,0 +1,208 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include "utils/Tracer.hpp"
+#include "utils/Stage.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+struct TraceEvent {
+    int64_t start;
+    int64_t end;
+    uint64_t frame;
+    Stage stage;
+};
+
+// Written by its owner thread only, the reader sees the events up to size
+struct ThreadBuffer {
+    static constexpr size_t capacity = 1 << 16;
+
+    std::unique_ptr<TraceEvent[]> events{new TraceEvent[capacity]};
+    std::atomic<size_t> size{0};
+    pid_t tid = 0;
+    std::string name;
+};
+
+// Buffers live until exit, a thread may still be appending while the file is written
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+thread_local ThreadBuffer* localBuffer = nullptr;
+thread_local uint64_t localFrame = 0;
+
+std::string tracePath;
+int64_t traceDeadline = 0;
+uint64_t traceFrameLimit = 0;
+std::atomic<uint64_t> traceFrames{0};
+std::once_flag writeOnce;
+std::thread writer;
+
+ThreadBuffer* LocalBuffer() {
+    if (!localBuffer) {
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->tid = static_cast<pid_t>(syscall(SYS_gettid));
+        char name[16] = {};
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        buffer->name = name;
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        localBuffer = buffer.get();
+        registry.push_back(std::move(buffer));
+    }
+    return localBuffer;
+}
+
+std::string Escaped(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += static_cast<unsigned char>(c) < 0x20 ? ' ' : c;
+    }
+    return out;
+}
+
+} // namespace
+
+std::atomic<bool> Tracer::enabled{false};
+
+void Tracer::Start(const std::string& path, double seconds, uint64_t frames) {
+    tracePath = path;
+    traceDeadline = seconds > 0 ? MonotonicNs() + static_cast<int64_t>(seconds * 1e9) : 0;
+    traceFrameLimit = frames;
+    traceFrames = 0;
+    enabled = true;
+
+    std::cout << "Tracing to " << path;
+    if (seconds > 0) {
+        std::cout << " for " << seconds << " s";
+    }
+    if (frames) {
+        std::cout << (seconds > 0 ? " or " : " for ") << frames << " frames";
+    }
+    std::cout << std::endl;
+}
+
+void Tracer::Stop() {
+    if (enabled.exchange(false)) {
+        std::call_once(writeOnce, Write);
+    }
+    if (writer.joinable()) {
+        writer.join();
+    }
+}
+
+void Tracer::SetFrame(uint64_t frame) {
+    localFrame = frame;
+}
+
+uint64_t Tracer::Frame() {
+    return localFrame;
+}
+
+void Tracer::Record(Stage stage, int64_t startNs, int64_t endNs) {
+    Record(stage, startNs, endNs, localFrame);
+}
+
+void Tracer::Record(Stage stage, int64_t startNs, int64_t endNs, uint64_t frame) {
+    if (!Enabled()) {
+        return;
+    }
+
+    ThreadBuffer* buffer = LocalBuffer();
+    size_t size = buffer->size.load(std::memory_order_relaxed);
+    if (size == ThreadBuffer::capacity) {
+        return;
+    }
+    buffer->events[size] = {startNs, endNs, frame, stage};
+    buffer->size.store(size + 1, std::memory_order_release);
+}
+
+void Tracer::FrameDone() {
+    if (!Enabled()) {
+        return;
+    }
+
+    uint64_t frames = ++traceFrames;
+    if ((traceFrameLimit && frames >= traceFrameLimit) || (traceDeadline && MonotonicNs() >= traceDeadline)) {
+        Finish();
+    }
+}
+
+// Off the streaming thread, the file can take a while for a long trace
+void Tracer::Finish() {
+    if (enabled.exchange(false)) {
+        std::call_once(writeOnce, [] { writer = std::thread(Write); });
+    }
+}
+
+void Tracer::Write() {
+    std::ofstream file(tracePath);
+    if (!file) {
+        std::cerr << "Could not write the trace to " << tracePath << std::endl;
+        return;
+    }
+
+    const pid_t pid = getpid();
+    size_t count = 0;
+    bool truncated = false;
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << pid
+         << ",\"args\":{\"name\":\"odetect\"}}";
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const auto& buffer : registry) {
+        file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+             << ",\"args\":{\"name\":\"" << Escaped(buffer->name) << "\"}}";
+
+        size_t size = buffer->size.load(std::memory_order_acquire);
+        truncated |= size == ThreadBuffer::capacity;
+        for (size_t i = 0; i < size; i++) {
+            const TraceEvent& event = buffer->events[i];
+            file << ",\n{\"name\":\"" << StageName(event.stage) << "\",\"cat\":\"odetect\",\"ph\":\"X\""
+                 << ",\"ts\":" << event.start / 1000 << "." << event.start / 100 % 10
+                 << ",\"dur\":" << (event.end - event.start) / 1000 << "." << (event.end - event.start) / 100 % 10
+                 << ",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+                 << ",\"args\":{\"frame\":" << event.frame << "}}";
+        }
+        count += size;
+    }
+    file << "\n]}\n";
+
+    std::cout << "Trace written to " << tracePath << " (" << count << " spans, " << registry.size() << " threads"
+              << (truncated ? ", some thread buffers were full" : "") << ")" << std::endl;
+}
\ No newline at end of file
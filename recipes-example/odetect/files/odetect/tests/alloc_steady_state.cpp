@@ -0,0 +1,226 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+// Runs IModelDnnDetector's frame path (copy, color conversion, zones, motion gate,
+// remembered detections, drawing) on synthetic YUYV frames under AllocTracker and fails
+// if a steady state frame allocates in the checked stages. Two kinds of detectors go
+// through it: one whose network is replaced by fixed detections with landmarks, and the
+// real models (ResNet10 SSD, YOLOv5 face, the cascade) on a backend that replays canned
+// output tensors, so that their Decode, NMS and the output copies of the split passes
+// run as well. No model files are needed. Without ODETECT_ALLOC_TRACKING only the
+// detections are checked.
+
+#include "interfaces/models/IModelDnnDetector.hpp"
+#include "factories/BackendFactory.hpp"
+#include "factories/ModelFactory.hpp"
+#include "utils/AllocTracker.hpp"
+#include "utils/RoiMask.hpp"
+#include "utils/Stage.hpp"
+
+#include <linux/videodev2.h>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class SyntheticDetector : public IModelDnnDetector {
+public:
+    explicit SyntheticDetector(const ODCaps& caps) : IModelDnnDetector(caps) {
+        inputSize = cv::Size(300, 300);
+        modelThreshold = 0.5f;
+    }
+
+    // A face with landmarks and one without around the middle of the frame
+    void Infer(const cv::Mat& bgrFrame, float threshold, std::vector<ODDetection>& detections) const override {
+        ODETECT_STAGE(Stage::Decode);
+        const cv::Point center(bgrFrame.cols / 2, bgrFrame.rows / 2);
+        ODDetection face = {cv::Rect(center.x - 40, center.y - 40, 80, 80), 0.9f, {}};
+        for (int i = 0; i < 5; i++) {
+            face.landmarks.push_back(center + cv::Point(i * 10 - 20, i % 2 * 10));
+        }
+        detections.push_back(face);
+        if (threshold < 0.7f) {
+            detections.push_back({cv::Rect(center.x + 50, center.y - 20, 40, 40), 0.7f, {}});
+        }
+    }
+};
+
+// Replays fixed outputs in the layout of the model's network: detection_out for the
+// Caffe SSD, the YOLOv5 face head for ONNX
+class CannedBackend : public IInferenceBackend {
+private:
+    const cv::Mat out;
+
+    class CannedContext : public Context {
+    private:
+        const cv::Mat& out;
+
+    public:
+        explicit CannedContext(const cv::Mat& out) : out(out) {}
+
+        void Forward(const cv::Mat&, std::vector<cv::Mat>& outs) override {
+            ODETECT_STAGE(Stage::Forward);
+            outs.resize(1);
+            CopyOutput(out, outs[0]);
+        }
+    };
+
+    // [1, 1, rows, 7], rows are [image, label, confidence, x1, y1, x2, y2]
+    static cv::Mat SsdOutput() {
+        const int sizes[] = {1, 1, 100, 7};
+        cv::Mat out(4, sizes, CV_32F, cv::Scalar(0));
+        cv::Mat table(sizes[2], sizes[3], CV_32F, out.ptr<float>());
+        const float hits[][7] = {
+            {0, 1, 0.9f, 0.45f, 0.40f, 0.55f, 0.55f},
+            {0, 1, 0.8f, 0.10f, 0.10f, 0.20f, 0.25f},
+            {0, 1, 0.5f, 0.70f, 0.60f, 0.80f, 0.75f}, // under the model threshold
+        };
+        for (int i = 0; i < 3; i++) {
+            for (int k = 0; k < 7; k++) {
+                table.at<float>(i, k) = hits[i][k];
+            }
+        }
+        return out;
+    }
+
+    // [1, rows, 16], rows are [cx, cy, w, h, box score, 5 landmarks, face score] logits of
+    // 3 anchors per cell of the stride 8, 16 and 32 grids
+    static cv::Mat YoloOutput(const cv::Size& input) {
+        const int strides[] = {8, 16, 32};
+        int rows = 0;
+        for (int stride : strides) {
+            rows += 3 * (input.width / stride) * (input.height / stride);
+        }
+        const int sizes[] = {1, rows, 16};
+        cv::Mat out(3, sizes, CV_32F, cv::Scalar(-10));
+        cv::Mat table(rows, 16, CV_32F, out.ptr<float>());
+
+        // Anchor q of cell (i, j) on the stride 16 grid, size scales the anchor
+        const int gridX = input.width / 16, gridY = input.height / 16;
+        const int level = 3 * (input.width / 8) * (input.height / 8);
+        auto hit = [&](int q, int i, int j, float size, float score) {
+            float* row = table.ptr<float>(level + (q * gridY + i) * gridX + j);
+            row[0] = row[1] = 0;
+            row[2] = row[3] = size;
+            row[4] = score;
+            for (int k = 5; k < 15; k++) {
+                row[k] = 0.5f;
+            }
+            row[15] = score;
+        };
+        hit(1, gridY / 2, gridX / 2, 0, 3);
+        // Overlaps the first one, NMS drops it
+        hit(2, gridY / 2, gridX / 2, -0.46f, 2);
+        hit(0, 1, 1, 0, 2.5f);
+        return out;
+    }
+
+public:
+    explicit CannedBackend(cv::Mat out) : out(std::move(out)) {}
+
+    std::unique_ptr<Context> CreateContext() override {
+        return std::make_unique<CannedContext>(out);
+    }
+
+    static std::unique_ptr<IInferenceBackend> Construct(const ModelSource& source, const BackendParams& params) {
+        return std::make_unique<CannedBackend>(source.format == ModelFormat::Caffe ? SsdOutput() : YoloOutput(params.inputSize));
+    }
+};
+
+struct Case {
+    std::string name;
+    std::unique_ptr<IModelDnnDetector> detector;
+    size_t detections; // expected per frame, 0 - at least one
+    bool pipelined;    // also through Prepare, Forward and Finish
+};
+
+int main() {
+    const ODCaps caps = {640, 480, V4L2_PIX_FMT_YUYV, 2};
+    BackendFactory::factory["canned"] = {{ModelFormat::Caffe, ModelFormat::Onnx}, {Precision::FP32}, &CannedBackend::Construct};
+
+    std::vector<Case> cases;
+    auto synthetic = std::make_unique<SyntheticDetector>(caps);
+    synthetic->SetRoi(std::make_shared<RoiMask>("100,80,440,320", cv::Size(caps.width, caps.height), cv::Size(caps.width, caps.height)));
+    synthetic->SetMotionGate(0.1f, 30);
+    cases.push_back({"synthetic", std::move(synthetic), 2, false});
+
+    DetectorParams params;
+    params.threshold = 0;
+    params.backend.name = "canned";
+    cases.push_back({"ResNet10SSDFaceDetector", nullptr, 2, true});
+    cases.push_back({"Yolo5sPersonDetector", nullptr, 2, true});
+    cases.push_back({"SsdYoloCascadeDetector", nullptr, 0, true});
+    for (auto& test : cases) {
+        if (!test.detector) {
+            test.detector = ModelFactory::factory.at(test.name)("/nonexistent", caps, &params);
+        }
+    }
+
+    std::vector<uint8_t> in(caps.width * caps.height * caps.channels);
+    std::vector<uint8_t> out(caps.width * caps.height * 3);
+    // A gray ramp that shifts from frame to frame
+    auto fill = [&in](int frame) {
+        for (size_t k = 0; k < in.size(); k++) {
+            in[k] = static_cast<uint8_t>(k % 2 ? 128 : (k / 2 + frame * 8) % 256);
+        }
+    };
+
+    bool passed = true;
+    fill(0);
+    std::vector<ODDetection> detections;
+    for (const auto& test : cases) {
+        test.detector->Detect(in.data(), detections);
+        bool expected = test.detections ? detections.size() == test.detections : !detections.empty();
+        std::cout << test.name << ": " << detections.size() << " detections" << (expected ? "" : ", unexpected") << std::endl;
+        passed &= expected;
+    }
+
+    if (!AllocTracker::Available()) {
+        std::cout << "Allocation check skipped, needs a build with ODETECT_ALLOC_TRACKING" << std::endl;
+        return passed ? 0 : 1;
+    }
+
+    // Each frame goes through every detector, the pipelined ones both ways
+    const int checkFrames = 100;
+    AllocTracker::Start(checkFrames, 0);
+    for (int i = 0; i < AllocTracker::warmUpFrames + checkFrames; i++) {
+        fill(i);
+
+        AllocTracker::FrameBegin();
+        for (const auto& test : cases) {
+            test.detector->Detect(in.data(), out.data());
+            if (test.pipelined) {
+                IModelDnnDetector::FrameLease frame = test.detector->Prepare(in.data());
+                test.detector->Forward(*frame);
+                test.detector->Finish(*frame, out.data());
+            }
+        }
+        AllocTracker::FrameDone();
+    }
+    AllocTracker::Stop();
+
+    return passed && AllocTracker::Finished() && AllocTracker::Passed() ? 0 : 1;
+}
\ No newline at end of file
@@ -0,0 +1,235 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+// Loopback receiver for the odetect RTP stream. Reads the capture time and frame
+// sequence extensions stamped by FrameLineage and reports capture to RTP egress
+// latency, its jitter and the packet and frame loss once per interval. Must run on
+// the same host as odetect, both read the system monotonic clock.
+
+#include "runtime/FrameLineage.hpp"
+#include "cxxopts.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <vector>
+
+struct RtpPacket {
+    uint16_t seq;
+    bool marker;
+    bool hasCaptureTime;
+    uint64_t captureTime;
+    bool hasFrameSeq;
+    uint32_t frameSeq;
+};
+
+struct IntervalStats {
+    std::vector<double> latencies;
+    double jitter = 0;
+    uint64_t packets = 0;
+    uint64_t lostPackets = 0;
+    uint64_t missingFrames = 0;
+};
+
+static uint64_t MonotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+static uint64_t ReadBE(const uint8_t* data, size_t len) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < len; i++) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+// RTP header with a one-byte header extension (RFC 3550, RFC 8285)
+static bool ParseRtp(const uint8_t* data, size_t len, RtpPacket& packet) {
+    if (len < 12 || (data[0] >> 6) != 2) {
+        return false;
+    }
+    packet = {static_cast<uint16_t>(ReadBE(data + 2, 2)), (data[1] & 0x80) != 0, false, 0, false, 0};
+
+    size_t offset = 12 + 4 * (data[0] & 0x0f);
+    if (!(data[0] & 0x10) || len < offset + 4 || ReadBE(data + offset, 2) != 0xBEDE) {
+        return true;
+    }
+    size_t end = offset + 4 + 4 * ReadBE(data + offset + 2, 2);
+    offset += 4;
+    if (end > len) {
+        return false;
+    }
+
+    while (offset < end) {
+        uint8_t id = data[offset] >> 4;
+        size_t elementLen = (data[offset] & 0x0f) + 1;
+        if (id == 0) {
+            offset++;
+            continue;
+        }
+        if (id == 15 || offset + 1 + elementLen > end) {
+            break;
+        }
+        const uint8_t* element = data + offset + 1;
+        if (id == FrameLineage::CaptureTimeExtId && elementLen == 8) {
+            packet.hasCaptureTime = true;
+            packet.captureTime = ReadBE(element, 8);
+        } else if (id == FrameLineage::FrameSeqExtId && elementLen == 4) {
+            packet.hasFrameSeq = true;
+            packet.frameSeq = ReadBE(element, 4);
+        }
+        offset += 1 + elementLen;
+    }
+    return true;
+}
+
+static void Report(IntervalStats& stats) {
+    std::vector<double>& lat = stats.latencies;
+    if (lat.empty()) {
+        std::cout << "frames 0 packets " << stats.packets << " lost " << stats.lostPackets << std::endl;
+        return;
+    }
+
+    std::sort(lat.begin(), lat.end());
+    double sum = 0;
+    for (double l : lat) {
+        sum += l;
+    }
+    std::cout << "frames " << lat.size()
+              << " latency ms avg " << sum / lat.size()
+              << " p50 " << lat[lat.size() / 2]
+              << " p95 " << lat[lat.size() * 95 / 100]
+              << " max " << lat.back()
+              << " jitter " << stats.jitter
+              << " packets " << stats.packets
+              << " lost " << stats.lostPackets
+              << " missing_frames " << stats.missingFrames << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    int port;
+    double interval;
+
+    try {
+        cxxopts::Options options("odetect-latency-probe", "Capture to RTP egress latency of a local odetect stream");
+
+        options.add_options()
+            ("p,port", "UDP port to listen on (odetect --latency_probe_port)", cxxopts::value<int>()->default_value("5002"))
+            ("i,interval", "Report interval, s", cxxopts::value<double>()->default_value("1"))
+            ("h,help", "Print usage");
+
+        auto result = options.parse(argc, argv);
+        if (result.count("help")) {
+            std::cout << options.help() << std::endl;
+            return 0;
+        }
+        port = result["port"].as<int>();
+        interval = result["interval"].as<double>();
+    } catch (const std::exception& e) {
+        std::cerr << "Error parsing options: " << e.what() << std::endl;
+        return 1;
+    }
+
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (sock < 0 || bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+        std::cerr << "Can't listen on 127.0.0.1:" << port << std::endl;
+        return 1;
+    }
+    timeval timeout = {0, 100000};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    IntervalStats stats;
+    bool started = false;
+    uint16_t expectedSeq = 0;
+    bool haveFrame = false;
+    uint32_t lastFrameSeq = 0;
+    bool haveLatency = false;
+    double lastLatency = 0;
+    double jitter = 0;
+    uint64_t intervalNs = static_cast<uint64_t>(interval * 1e9);
+    uint64_t nextReport = MonotonicNs() + intervalNs;
+
+    std::vector<uint8_t> data(65536);
+    while (true) {
+        ssize_t len = recv(sock, data.data(), data.size(), 0);
+        uint64_t now = MonotonicNs();
+
+        RtpPacket packet;
+        if (len > 0 && ParseRtp(data.data(), len, packet)) {
+            stats.packets++;
+            if (started && packet.seq != expectedSeq) {
+                uint16_t gap = static_cast<uint16_t>(packet.seq - expectedSeq);
+                // Reordered or duplicated packets show up as huge gaps, not counted
+                if (gap < 0x8000) {
+                    stats.lostPackets += gap;
+                }
+            }
+            started = true;
+            expectedSeq = packet.seq + 1;
+
+            // A frame has left once its last packet has
+            if (packet.marker && packet.hasCaptureTime && now > packet.captureTime) {
+                double latency = (now - packet.captureTime) / 1e6;
+                if (haveLatency) {
+                    jitter += (std::fabs(latency - lastLatency) - jitter) / 16;
+                }
+                haveLatency = true;
+                lastLatency = latency;
+                stats.latencies.push_back(latency);
+                stats.jitter = jitter;
+
+                if (packet.hasFrameSeq) {
+                    if (haveFrame && packet.frameSeq > lastFrameSeq + 1) {
+                        stats.missingFrames += packet.frameSeq - lastFrameSeq - 1;
+                    }
+                    haveFrame = true;
+                    lastFrameSeq = packet.frameSeq;
+                }
+            }
+        }
+
+        if (now >= nextReport) {
+            Report(stats);
+            stats = IntervalStats();
+            stats.jitter = jitter;
+            nextReport = now + intervalNs;
+        }
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,234 @@
+/*
+
+Copyright (c) 2014-2024 Pavel Batsekin pavelbats@gmail.com
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+// Offline accuracy guard for reduced precision modes. Runs a model at fp32 and at the
+// requested precision over a reference clip set, measures the recall of the reduced
+// precision detections against the fp32 ones and records the verdict for odetect.
+
+#include "factories/ModelFactory.hpp"
+#include "utils/PrecisionGuard.hpp"
+#include "cxxopts.hpp"
+
+#include <opencv2/opencv.hpp>
+#include <linux/videodev2.h>
+#include <algorithm>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <utility>
+
+struct DetectorPair {
+    std::unique_ptr<IModelDnnDetector> reference;
+    std::unique_ptr<IModelDnnDetector> candidate;
+};
+
+struct RecallStats {
+    size_t frames = 0;
+    size_t reference = 0;
+    size_t matched = 0;
+    size_t extra = 0;
+};
+
+static float IoU(const cv::Rect& a, const cv::Rect& b) {
+    float inter = (a & b).area();
+    float uni = a.area() + b.area() - inter;
+    return uni > 0 ? inter / uni : 0;
+}
+
+static void Match(const std::vector<ODDetection>& reference, const std::vector<ODDetection>& candidate, float iouThreshold, RecallStats& stats) {
+    std::vector<bool> used(candidate.size(), false);
+
+    for (const auto& ref : reference) {
+        int best = -1;
+        float bestIoU = iouThreshold;
+        for (size_t i = 0; i < candidate.size(); i++) {
+            float iou = IoU(ref.box, candidate[i].box);
+            if (!used[i] && iou >= bestIoU) {
+                best = i;
+                bestIoU = iou;
+            }
+        }
+        if (best >= 0) {
+            used[best] = true;
+            stats.matched++;
+        }
+    }
+
+    stats.reference += reference.size();
+    stats.extra += std::count(used.begin(), used.end(), false);
+}
+
+static std::vector<std::string> ListClips(const std::string& path) {
+    std::vector<std::string> clips;
+
+    if (std::filesystem::is_directory(path)) {
+        for (const auto& entry : std::filesystem::directory_iterator(path)) {
+            if (entry.is_regular_file()) {
+                clips.push_back(entry.path().string());
+            }
+        }
+        std::sort(clips.begin(), clips.end());
+    } else {
+        clips.push_back(path);
+    }
+
+    return clips;
+}
+
+int main(int argc, char* argv[]) {
+    std::string model_dir;
+    std::string model_name;
+    std::string clips_path;
+    std::string guard_path;
+    DetectorParams reference_params;
+    DetectorParams candidate_params;
+    std::string precision;
+    int stride;
+    int max_frames;
+    float min_recall;
+    float iou_threshold;
+
+    try {
+        cxxopts::Options options("odetect-validate", "Validates reduced precision inference against fp32");
+
+        options.add_options()
+            ("d,model_directory", "Model Directory", cxxopts::value<std::string>()->default_value("/usr/share/odetect"))
+            ("name", "Model Name", cxxopts::value<std::string>()->default_value("ResNet10SSDFaceDetector"))
+            ("t,threshold", "Model Confidence Threshold (0..1]", cxxopts::value<float>()->default_value("0.6"))
+            ("precision", "Precision to validate: fp16|int8", cxxopts::value<std::string>())
+            ("backend", "Backend of the validated precision", cxxopts::value<std::string>()->default_value("opencv"))
+            ("reference_backend", "Backend of the fp32 reference", cxxopts::value<std::string>()->default_value("opencv"))
+            ("clips", "Reference clip set: a directory of videos/images or a single file", cxxopts::value<std::string>())
+            ("stride", "Use every Nth frame of a video", cxxopts::value<int>()->default_value("5"))
+            ("max_frames", "Frames per clip at most (0 - all)", cxxopts::value<int>()->default_value("0"))
+            ("min_recall", "Refuse the mode below this recall against fp32", cxxopts::value<float>()->default_value("0.95"))
+            ("iou", "IoU for a detection to match the reference", cxxopts::value<float>()->default_value("0.5"))
+            ("guard", "Precision guard file (default <model_directory>/precision.guard)", cxxopts::value<std::string>())
+            ("h,help", "Print usage");
+
+        auto result = options.parse(argc, argv);
+
+        if (result.count("help") || !result.count("precision") || !result.count("clips")) {
+            std::cout << "Usage:\n  odetect-validate --precision <fp16|int8> --clips <dir> [OPTION...]\n\n";
+            std::cout << options.help() << std::endl;
+            return result.count("help") ? 0 : 1;
+        }
+
+        model_dir = result["model_directory"].as<std::string>();
+        model_name = result["name"].as<std::string>();
+        clips_path = result["clips"].as<std::string>();
+        guard_path = result.count("guard") ? result["guard"].as<std::string>() : model_dir + "/precision.guard";
+        precision = result["precision"].as<std::string>();
+        stride = std::max(1, result["stride"].as<int>());
+        max_frames = result["max_frames"].as<int>();
+        min_recall = result["min_recall"].as<float>();
+        iou_threshold = result["iou"].as<float>();
+
+        reference_params.threshold = result["threshold"].as<float>();
+        reference_params.backend.name = result["reference_backend"].as<std::string>();
+        reference_params.backend.precision = Precision::FP32;
+        candidate_params.threshold = reference_params.threshold;
+        candidate_params.backend.name = result["backend"].as<std::string>();
+        candidate_params.backend.precision = ParsePrecision(precision);
+    } catch (const std::exception& e) {
+        std::cerr << "Error parsing options: " << e.what() << std::endl;
+        return 1;
+    }
+
+    auto model_unit = ModelFactory::factory.find(model_name);
+    if (model_unit == ModelFactory::factory.end()) {
+        std::cerr << "Incorrect model name. Call odetect -l\n";
+        return 1;
+    }
+
+    // Detectors are bound to the input size, one pair per clip resolution
+    std::map<std::pair<int, int>, DetectorPair> detectors;
+    RecallStats stats;
+
+    try {
+        for (const auto& clip : ListClips(clips_path)) {
+            cv::VideoCapture capture(clip);
+            if (!capture.isOpened()) {
+                std::cerr << "Skipping " << clip << ": can't open" << std::endl;
+                continue;
+            }
+
+            cv::Mat frame;
+            int index = 0;
+            int used = 0;
+            while (capture.read(frame) && (!max_frames || used < max_frames)) {
+                if (index++ % stride) {
+                    continue;
+                }
+                if (frame.type() != CV_8UC3) {
+                    continue;
+                }
+                if (!frame.isContinuous()) {
+                    frame = frame.clone();
+                }
+
+                DetectorPair& pair = detectors[{frame.cols, frame.rows}];
+                if (!pair.reference) {
+                    ODCaps caps = {static_cast<uint16_t>(frame.cols), static_cast<uint16_t>(frame.rows), V4L2_PIX_FMT_BGR24, 3};
+                    pair.reference = model_unit->second(model_dir, caps, &reference_params);
+                    pair.candidate = model_unit->second(model_dir, caps, &candidate_params);
+                }
+
+                std::vector<ODDetection> reference, candidate;
+                pair.reference->Detect(frame.data, reference);
+                pair.candidate->Detect(frame.data, candidate);
+                Match(reference, candidate, iou_threshold, stats);
+
+                stats.frames++;
+                used++;
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Validation failed: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (!stats.reference) {
+        std::cerr << "No fp32 detections in the clip set, nothing to validate against" << std::endl;
+        return 1;
+    }
+
+    float recall = static_cast<float>(stats.matched) / stats.reference;
+    bool accepted = recall >= min_recall;
+
+    std::cout << model_name << " " << candidate_params.backend.name << " " << precision << ": "
+              << stats.frames << " frames, " << stats.reference << " fp32 detections, "
+              << stats.matched << " matched, " << stats.extra << " extra, recall " << recall
+              << (accepted ? " - accepted" : " - refused") << std::endl;
+
+    try {
+        PrecisionGuard(guard_path).Record(model_name, candidate_params.backend.name, precision, recall, accepted);
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return accepted ? 0 : 2;
+}
\ No newline at end of file